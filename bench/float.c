@@ -0,0 +1,87 @@
+/*===--------------------------------------------------------------------------------------------===
+ * float.c
+ *
+ * Compares the float conversion built into the lexer with atof and strtod, on the kind of numbers
+ * found in GPS almanacs and on full-precision doubles. Build with:
+ *
+ *     cc -O2 -I.. ../parser.c float.c -lm -o float && ./float
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2022 Amy Parent. All rights reserved
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define COUNT   (1000000)
+#define ROUNDS  (5)
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double seconds, size_t bytes, double sum) {
+    printf("%-8s %6.2f ns/float %8.1f MB/s   (checksum %.17g)\n",
+        name, seconds * 1e9 / (COUNT * ROUNDS), bytes * ROUNDS / seconds / 1e6, sum);
+}
+
+// Writes COUNT numbers with [format] and times every converter on them.
+static void run(const char *title, const char *format) {
+    size_t cap = COUNT * 32;
+    char *src = malloc(cap);
+    const char **starts = malloc(COUNT * sizeof(*starts));
+    size_t len = 0;
+
+    srand(42);
+    for(int i = 0; i < COUNT; ++i) {
+        double value = (rand() / (double)RAND_MAX - 0.5) * pow(10, rand() % 8 - 6);
+        starts[i] = src + len;
+        len += snprintf(src + len, cap - len, format, value);
+    }
+
+    printf("%s\n", title);
+    double start, sum;
+
+    sum = 0;
+    start = now();
+    for(int r = 0; r < ROUNDS; ++r) {
+        parser_t parser = {0};
+        parse_init(&parser, src, len);
+        for(int i = 0; i < COUNT; ++i) sum += parse_float(&parser);
+        parse_fini(&parser);
+    }
+    report("parser", now() - start, len, sum);
+
+    sum = 0;
+    start = now();
+    for(int r = 0; r < ROUNDS; ++r) {
+        for(int i = 0; i < COUNT; ++i) sum += strtod(starts[i], NULL);
+    }
+    report("strtod", now() - start, len, sum);
+
+    sum = 0;
+    start = now();
+    for(int r = 0; r < ROUNDS; ++r) {
+        for(int i = 0; i < COUNT; ++i) sum += atof(starts[i]);
+    }
+    report("atof", now() - start, len, sum);
+
+    free(starts);
+    free(src);
+}
+
+int main(void) {
+    // As written in a SEM almanac, e.g. -4.730224609375E-004: 13 digits, within Clinger's path.
+    run("almanac (13 digits)", "%.12E\n");
+    // Every digit a double needs to round-trip, which Clinger's path can't do exactly.
+    run("full precision (17 digits)", "%.16E\n");
+    return 0;
+}
@@ -7,56 +7,325 @@
  * Licensed under the MIT License
  *===--------------------------------------------------------------------------------------------===
 */
+#if defined(__unix__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "parser.h"
-#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#include <locale.h>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define PARSE_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PARSE_HAS_MMAP 0
+#endif
+
+// The vector kernels are written once against these few operations, for either AVX2 or SSE2.
+#if defined(PARSE_NO_SIMD)
+#elif defined(__AVX2__)
+#define PARSE_SIMD 32
+#include <immintrin.h>
+typedef __m256i vec_t;
+#define vec_load(ptr)   _mm256_loadu_si256((const __m256i *)(ptr))
+#define vec_set(c)      _mm256_set1_epi8(c)
+#define vec_eq(a, b)    _mm256_cmpeq_epi8(a, b)
+#define vec_or(a, b)    _mm256_or_si256(a, b)
+#define vec_sub(a, b)   _mm256_sub_epi8(a, b)
+#define vec_min(a, b)   _mm256_min_epu8(a, b)
+#define vec_mask(v)     ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARSE_SIMD 16
+#include <emmintrin.h>
+typedef __m128i vec_t;
+#define vec_load(ptr)   _mm_loadu_si128((const __m128i *)(ptr))
+#define vec_set(c)      _mm_set1_epi8(c)
+#define vec_eq(a, b)    _mm_cmpeq_epi8(a, b)
+#define vec_or(a, b)    _mm_or_si128(a, b)
+#define vec_sub(a, b)   _mm_sub_epi8(a, b)
+#define vec_min(a, b)   _mm_min_epu8(a, b)
+#define vec_mask(v)     ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if !defined(PARSE_NO_THREADS) && (defined(__unix__) || (defined(__APPLE__) && defined(__MACH__)))
+#define PARSE_HAS_THREADS 1
+#include <pthread.h>
+#else
+#define PARSE_HAS_THREADS 0
+#endif
+
+// Per-thread locales (POSIX.1-2008), so strtod can run in the C locale whatever setlocale() says.
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define PARSE_HAS_USELOCALE 1
+#else
+#define PARSE_HAS_USELOCALE 0
+#endif
 
 // We use a simple recursive descent lexer/parser
 
+// Arenas are a chain of blocks. Allocations are bumped out of the current block; blocks after it
+// are free, and are reused before any new one is allocated.
+struct parse_block_s {
+    parse_block_t   *next;
+    size_t          used, cap;
+};
 
-void parse_init(parser_t *parser, const char *src, size_t len) {
+#define BLOCK_HEADER ((sizeof(parse_block_t) + 15) & ~(size_t)15)
+
+void *parse_arena_alloc(parse_arena_t *arena, size_t size) {
+    PARSE_ASSERT(arena != NULL);
+    size = (size + 15) & ~(size_t)15;
+    
+    parse_block_t *block = arena->current;
+    if(!block || block->cap - block->used < size) {
+        parse_block_t *last = block;
+        block = block ? block->next : NULL;
+        while(block && block->cap < size) {
+            last = block;
+            block = block->next;
+        }
+        
+        if(block) {
+            block->used = 0;
+        } else {
+            size_t cap = arena->block_size ? arena->block_size : PARSE_ARENA_BLOCK;
+            if(cap < size) cap = size;
+            block = PARSE_CALLOC(1, BLOCK_HEADER + cap);
+            PARSE_ASSERT(block);
+            block->cap = cap;
+            if(last) {
+                last->next = block;
+            } else {
+                arena->first = block;
+            }
+        }
+        arena->current = block;
+    }
+    
+    char *out = (char *)block + BLOCK_HEADER + block->used;
+    block->used += size;
+    memset(out, 0, size);
+    return out;
+}
+
+parse_arena_mark_t parse_arena_mark(parse_arena_t *arena) {
+    PARSE_ASSERT(arena != NULL);
+    parse_arena_mark_t mark = {arena->current, arena->current ? arena->current->used : 0};
+    return mark;
+}
+
+void parse_arena_release(parse_arena_t *arena, parse_arena_mark_t mark) {
+    PARSE_ASSERT(arena != NULL);
+    arena->current = mark.block ? mark.block : arena->first;
+    if(arena->current) arena->current->used = mark.used;
+}
+
+void parse_arena_reset(parse_arena_t *arena) {
+    parse_arena_mark_t start = {NULL, 0};
+    parse_arena_release(arena, start);
+}
+
+void parse_arena_fini(parse_arena_t *arena) {
+    PARSE_ASSERT(arena != NULL);
+    parse_block_t *block = arena->first;
+    while(block) {
+        parse_block_t *next = block->next;
+        PARSE_FREE(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+// What the parser owns comes from its arena if it has one, from PARSE_CALLOC otherwise. Memory
+// from an arena is only given back by parse_fini, all at once, so the parser's allocations must
+// stay on top of the arena: anything allocated above them would be released with them.
+static bool at_arena_top(const parser_t *parser) {
+    parse_arena_mark_t top = parse_arena_mark(parser->arena);
+    return top.block == parser->arena_top.block && top.used == parser->arena_top.used;
+}
+
+static void *alloc_in(parser_t *parser, size_t count, size_t size) {
+    if(!parser->arena) return PARSE_CALLOC(count, size);
+    PARSE_ASSERT(at_arena_top(parser));
+    void *out = parse_arena_alloc(parser->arena, count * size);
+    parser->arena_top = parse_arena_mark(parser->arena);
+    return out;
+}
+
+static void free_in(parser_t *parser, void *ptr) {
+    if(!parser->arena) PARSE_FREE(ptr);
+}
+
+void parse_init_arena(parser_t *parser, parse_arena_t *arena) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(arena != NULL);
+    memset(parser, 0, sizeof(*parser));
+    parser->arena = arena;
+    parser->arena_mark = parse_arena_mark(arena);
+    parser->arena_top = parser->arena_mark;
+    parser->tok.kind = TOK_EOF;
+}
+
+static void init_buffer(parser_t *parser, const char *src, size_t len, bool padded, int line) {
     PARSE_ASSERT(parser != NULL);
     PARSE_ASSERT(src != NULL);
-    PARSE_ASSERT(len > 0);
+    
+    // Whatever the parser owns is kept for reuse, as are the arena marks: the buffer may already
+    // have come from the arena.
+    parse_arena_t *arena = parser->arena;
+    parse_arena_mark_t mark = parser->arena_mark;
+    parse_arena_mark_t top = parser->arena_top;
+    char *buf = parser->buf;
+    size_t buf_cap = parser->buf_cap;
+    uint32_t *nl_index = parser->nl_index;
+    size_t nl_cap = parser->nl_cap;
+    parse_token_t *toks = parser->toks;
+    size_t tok_cap = parser->tok_cap;
     
     memset(parser, 0, sizeof(*parser));
-    parser->owns_src = false;
+    parser->arena = arena;
+    parser->arena_mark = mark;
+    parser->arena_top = top;
+    parser->buf = buf;
+    parser->buf_cap = buf_cap;
+    parser->nl_index = nl_index;
+    parser->nl_cap = nl_cap;
+    parser->toks = toks;
+    parser->tok_cap = tok_cap;
+    parser->owns_src = src == buf;
+    parser->padded = padded;
     parser->src = src;
     parser->end = src + len;
     parser->ptr = src;
     
-    parser->line = 0;
+    parser->line = line;
     parser->column = 1;
+    parser->pos_base = src;
+    parser->base_line = line;
+    parser->base_column = 1;
+    parser->src_line_start = true;
     
     parser->error = NULL;
     parser->tok.kind = TOK_INVALID;
     lex(parser);
 }
 
+void parse_init(parser_t *parser, const char *src, size_t len) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(len > 0);
+    memset(parser, 0, sizeof(*parser));
+    init_buffer(parser, src, len, false, 0);
+}
+
+void parse_init_padded(parser_t *parser, const char *src, size_t len) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(len > 0);
+    PARSE_ASSERT(src != NULL && src[len] == '\0');
+    memset(parser, 0, sizeof(*parser));
+    init_buffer(parser, src, len, true, 0);
+}
+
+// Makes sure [*buf] can hold [size] bytes and the padding, keeping its first [keep] bytes. We
+// only have PARSE_CALLOC/PARSE_FREE, so growing means copying.
+static void reserve(parser_t *parser, char **buf, size_t *cap, size_t size, size_t keep) {
+    if(*buf && size <= *cap) return;
+    size_t bigger = *cap ? 2 * *cap : 4096;
+    if(bigger < size) bigger = size;
+    
+    char *grown = alloc_in(parser, bigger+PARSE_PADDING, sizeof(char));
+    PARSE_ASSERT(grown);
+    if(*buf) {
+        memcpy(grown, *buf, keep);
+        free_in(parser, *buf);
+    }
+    *buf = grown;
+    *cap = bigger;
+}
+
+// Reads the whole of [f] into [*buf], which holds [*cap] bytes plus padding and is grown if
+// needed. Streams we can't seek in (pipes, terminals, sockets) are read by doubling the buffer
+// until they run dry. Returns the number of bytes read, which are followed by zeroed padding.
+static size_t read_file(parser_t *parser, FILE *f, char **buf, size_t *cap) {
+    size_t len = 0;
+    long end = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    
+    if(end >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        reserve(parser, buf, cap, (size_t)end, 0);
+        len = fread(*buf, sizeof(char), (size_t)end, f);
+    } else {
+        clearerr(f);
+        reserve(parser, buf, cap, PARSE_STREAM_WINDOW, 0);
+        for(;;) {
+            len += fread(*buf + len, sizeof(char), *cap - len, f);
+            if(len < *cap) break;
+            reserve(parser, buf, cap, *cap + 1, len);
+        }
+    }
+    
+    memset(*buf + len, 0, PARSE_PADDING);
+    return len;
+}
+
 void parse_init_file(parser_t *parser, FILE *f) {
     PARSE_ASSERT(parser != NULL);
     PARSE_ASSERT(f != NULL);
     memset(parser, 0, sizeof(*parser));
     
-    fseek(f, 0, SEEK_END);
-    size_t size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    size_t size = read_file(parser, f, &parser->buf, &parser->buf_cap);
+    init_buffer(parser, parser->buf, size, true, 0);
+}
+
+void parse_init_path(parser_t *parser, const char *path) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(path != NULL);
+    memset(parser, 0, sizeof(*parser));
+    
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        parse_fail(parser, "can't open '%s' (%s)", path, strerror(errno));
+        return;
+    }
+    parse_init_file(parser, f);
+    fclose(f);
+}
+
+#if PARSE_HAS_MMAP
+// Maps [f] read-only. The kernel zero-fills the tail of the last page, so when that leaves at least
+// PARSE_PADDING bytes the mapping is as good as one of our padded buffers.
+static const char *map_file(FILE *f, size_t *size, bool *padded) {
+    struct stat st;
+    int fd = fileno(f);
+    if(fd < 0 || fstat(fd, &st) != 0) return NULL;
+    if(!S_ISREG(st.st_mode) || st.st_size <= 0) return NULL;
     
-    char *src = PARSE_CALLOC(size+1, sizeof(char));
-    PARSE_ASSERT(src);
-    fread(src, sizeof(char), size, f);
-    src[size] = '\0';
+    long page = sysconf(_SC_PAGESIZE);
+    if(page <= 0) return NULL;
     
-    parse_init(parser, src, size);
-    parser->owns_src = true;
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED) return NULL;
+    (void)posix_madvise(addr, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    
+    *size = (size_t)st.st_size;
+    *padded = st.st_size % page != 0 && page - st.st_size % page >= PARSE_PADDING;
+    return addr;
 }
+#endif
 
-void parse_init_path(parser_t *parser, const char *path) {
+void parse_init_mmap(parser_t *parser, const char *path) {
     PARSE_ASSERT(parser != NULL);
     PARSE_ASSERT(path != NULL);
     memset(parser, 0, sizeof(*parser));
@@ -66,26 +335,121 @@ void parse_init_path(parser_t *parser, const char *path) {
         parse_fail(parser, "can't open '%s' (%s)", path, strerror(errno));
         return;
     }
+    
+#if PARSE_HAS_MMAP
+    size_t size = 0;
+    bool padded = false;
+    const char *src = map_file(f, &size, &padded);
+    if(src) {
+        fclose(f);
+        init_buffer(parser, src, size, padded, 0);
+        parser->mapped_src = true;
+        return;
+    }
+#endif
+    
     parse_init_file(parser, f);
     fclose(f);
 }
 
+void parse_init_stream(parser_t *parser, parse_refill_t refill, void *data, size_t window) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(refill != NULL);
+    memset(parser, 0, sizeof(*parser));
+    if(!window) window = PARSE_STREAM_WINDOW;
+    
+    // One byte more than the window, so that a token as long as the window can still be followed
+    // by the byte that ends it.
+    char *src = alloc_in(parser, window+1+PARSE_PADDING, sizeof(char));
+    PARSE_ASSERT(src);
+    
+    parser->buf = src;
+    parser->buf_cap = window + 1;
+    parser->owns_src = true;
+    parser->padded = true;
+    parser->src = src;
+    parser->end = src;
+    parser->ptr = src;
+    parser->refill = refill;
+    parser->refill_data = data;
+    parser->window = window;
+    parser->src_line_start = true;
+    
+    parser->line = 0;
+    parser->column = 1;
+    parser->pos_base = src;
+    parser->base_line = 0;
+    parser->base_column = 1;
+    
+    parser->error = NULL;
+    parser->tok.kind = TOK_INVALID;
+    parser->tok.start = src;
+    lex(parser);
+}
+
+static size_t refill_file(void *data, char *buf, size_t cap) {
+    return fread(buf, sizeof(char), cap, (FILE *)data);
+}
+
+void parse_init_stream_file(parser_t *parser, FILE *f, size_t window) {
+    PARSE_ASSERT(f != NULL);
+    parse_init_stream(parser, refill_file, f, window);
+}
+
+static void unmap_src(parser_t *parser) {
+#if PARSE_HAS_MMAP
+    if(parser->src && parser->mapped_src) munmap((void *)parser->src, parser->end - parser->src);
+#endif
+    parser->mapped_src = false;
+}
+
+void parse_reset(parser_t *parser, const char *src, size_t len) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(len > 0);
+    unmap_src(parser);
+    init_buffer(parser, src, len, false, 0);
+}
+
+void parse_reinit_file(parser_t *parser, FILE *f) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(f != NULL);
+    unmap_src(parser);
+    
+    size_t size = read_file(parser, f, &parser->buf, &parser->buf_cap);
+    init_buffer(parser, parser->buf, size, true, 0);
+}
+
 void parse_fini(parser_t *parser) {
-    if(parser->src && parser->owns_src) free((char *)parser->src);
-    if(parser->error) free(parser->error);
+    unmap_src(parser);
+    if(parser->arena) {
+        PARSE_ASSERT(at_arena_top(parser));
+        parse_arena_release(parser->arena, parser->arena_mark);
+    } else {
+        if(parser->buf) PARSE_FREE(parser->buf);
+        if(parser->nl_index) PARSE_FREE(parser->nl_index);
+        if(parser->toks) PARSE_FREE(parser->toks);
+    }
     memset(parser, 0, sizeof(*parser));
 }
 
-static char *vsprintf_alloc(const char *fmt, va_list args) {
-    va_list args2;
-    va_copy(args2, args);
-    size_t len = vsnprintf(NULL, 0, fmt, args2);
-    va_end(args2);
+// Errors are recorded as a code and the token they happened on, with a fixed description in
+// parser->error. Only parse_fail formats anything up front, and only into parser->message: the
+// built-in errors are written out when parse_error_message asks for them.
+static void set_error(parser_t *parser, parse_error_code_t code, tok_kind_t expected,
+                      const char *description) {
+    parser->err.code = code;
+    parser->err.expected = expected;
+    parser->err.found = parser->tok.kind;
+    parser->err.offset = parser->tok.start ? (size_t)(parser->tok.start - parser->src) : 0;
+    parser->err.len = parser->tok.len;
+    parser->error = description;
     
-    PARSE_ASSERT(len > 0);
-    char *out = PARSE_CALLOC(len+1, 1);
-    (void)vsnprintf(out, len+1, fmt, args);
-    return out;
+    if(parser->errors) {
+        if(parser->error_count < parser->error_cap) {
+            parser->errors[parser->error_count] = parser->err;
+        }
+        parser->error_count += 1;
+    }
 }
 
 void parse_fail(parser_t *parser, const char *fmt, ...) {
@@ -93,18 +457,63 @@ void parse_fail(parser_t *parser, const char *fmt, ...) {
     
     va_list args;
     va_start(args, fmt);
-    parser->error = vsprintf_alloc(fmt, args);
+    (void)vsnprintf(parser->message, sizeof(parser->message), fmt, args);
     va_end(args);
+    set_error(parser, PARSE_ERR_FAIL, TOK_INVALID, parser->message);
+}
+
+void parse_range_error(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return;
+    set_error(parser, PARSE_ERR_RANGE, TOK_INT, "integer out of range");
+}
+
+static void rebase_positions(parser_t *parser, const char *keep);
+static bool starts_line(parser_t *parser, const char *at);
+
+// Slides the stream window: everything from the start of the token being scanned is moved to the
+// front of the window, and the space freed after it is filled from the refill callback.
+static bool refill(parser_t *parser) {
+    if(!parser->refill) return false;
+    
+    char *window = (char *)parser->src;
+    const char *keep = parser->tok.start;
+    size_t kept = parser->end - keep;
+    if(kept > parser->window) {
+        parse_fail(parser, "token longer than the %zu byte stream window", parser->window);
+        return false;
+    }
+    
+    rebase_positions(parser, keep);
+    parser->src_line_start = starts_line(parser, keep);
+    if(parser->sync_start) {
+        parser->sync_start = parser->sync_start >= keep
+            ? window + (parser->sync_start - keep)
+            : NULL;
+    }
+    memmove(window, keep, kept);
+    parser->ptr -= keep - window;
+    parser->tok.start = window;
+    parser->pos_base = window;
+    
+    // Only the sentinel needs to be zero: bytes after it are never looked at, just loaded.
+    size_t read = parser->refill(parser->refill_data, window + kept, parser->window + 1 - kept);
+    parser->end = window + kept + read;
+    window[kept + read] = '\0';
+    if(!read) parser->refill = NULL;
+    return read > 0;
 }
 
 static int advance(parser_t *parser) {
     if(parser->error) return 0;
-    if(parser->ptr == parser->end) return EOF;
-    int current = *parser->ptr++;
+    if(parser->ptr == parser->end && !refill(parser)) return EOF;
+    int current = (unsigned char)*parser->ptr++;
     
-    if(*parser->ptr == '\n') {
+    // With lazy positions, line/column are worked out from the newline index when asked for.
+    if(parser->lazy_pos) return current;
+    if(current == '\n') {
         parser->line += 1;
-        parser->column = 0;
+        parser->column = 1;
     } else {
         parser->column += 1;
     }
@@ -113,177 +522,1517 @@ static int advance(parser_t *parser) {
 
 static int peek(parser_t *parser) {
     if(parser->error) return 0;
-    if(parser->ptr == parser->end) return EOF;
-    return *parser->ptr;
+    if(parser->ptr == parser->end && !refill(parser)) return EOF;
+    return (unsigned char)*parser->ptr;
 }
 
-static void skip_whitespace(parser_t *parser) {
-    for(;;) {
-        switch(peek(parser)) {    
-        case '\t':
-        case '\r':
-        case ' ':
-        case '\n':
-            advance(parser);
-            break;
-        case '#':
-            while(peek(parser) != '\n' && peek(parser) != EOF) {
-                advance(parser);
-            }
-            break;
-        default: return;
-        }
-    }
+static inline int ctz32(uint32_t x) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
 }
 
-static inline bool is_tok_char(char c) {
-    return isalnum(c) || c == '.' || c == '+' || c == '-';
+static inline int ctz64(uint64_t x) {
+#if defined(_MSC_VER)
+    uint32_t low = (uint32_t)x;
+    return low ? ctz32(low) : 32 + ctz32((uint32_t)(x >> 32));
+#else
+    return __builtin_ctzll(x);
+#endif
 }
 
-static const tok_t *make_token(parser_t *parser) {
-    size_t len = 1;
-    
-    enum {
-        STATE_INT,
-        STATE_FLOAT,
-        STATE_EXP_SIGN,
-        STATE_EXP,
-        STATE_TEXT,
-    };
+// Byte classes used by every scanning loop, so classifying a byte is a single load. Bytes
+// outside of ASCII (and EOF, cast to unsigned char) have no class.
+enum {
+    CC_SPACE    = 1 << 0,
+    CC_NEWLINE  = 1 << 1,
+    CC_DIGIT    = 1 << 2,
+    CC_ALPHA    = 1 << 3,
+    CC_SIGN     = 1 << 4,
+    CC_DOT      = 1 << 5,
+    CC_EXP      = 1 << 6,
+    CC_COMMENT  = 1 << 7,
     
-    int state = STATE_INT; // We start with the most restrictive possible kind.
-    advance(parser);
+    CC_BLANK    = CC_SPACE | CC_NEWLINE,
+    CC_TOK      = CC_DIGIT | CC_ALPHA | CC_SIGN | CC_DOT,
+};
+
+static const uint8_t char_class[256] = {
+    ['\t'] = CC_SPACE, ['\r'] = CC_SPACE, [' '] = CC_SPACE, ['\n'] = CC_NEWLINE,
+    ['#'] = CC_COMMENT, ['.'] = CC_DOT, ['+'] = CC_SIGN, ['-'] = CC_SIGN,
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT,
+    ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    ['a'] = CC_ALPHA, ['b'] = CC_ALPHA, ['c'] = CC_ALPHA, ['d'] = CC_ALPHA,
+    ['e'] = CC_ALPHA | CC_EXP,
+    ['f'] = CC_ALPHA, ['g'] = CC_ALPHA, ['h'] = CC_ALPHA, ['i'] = CC_ALPHA, ['j'] = CC_ALPHA,
+    ['k'] = CC_ALPHA, ['l'] = CC_ALPHA, ['m'] = CC_ALPHA, ['n'] = CC_ALPHA, ['o'] = CC_ALPHA,
+    ['p'] = CC_ALPHA, ['q'] = CC_ALPHA, ['r'] = CC_ALPHA, ['s'] = CC_ALPHA, ['t'] = CC_ALPHA,
+    ['u'] = CC_ALPHA, ['v'] = CC_ALPHA, ['w'] = CC_ALPHA, ['x'] = CC_ALPHA, ['y'] = CC_ALPHA,
+    ['z'] = CC_ALPHA,
+    ['A'] = CC_ALPHA, ['B'] = CC_ALPHA, ['C'] = CC_ALPHA, ['D'] = CC_ALPHA,
+    ['E'] = CC_ALPHA | CC_EXP,
+    ['F'] = CC_ALPHA, ['G'] = CC_ALPHA, ['H'] = CC_ALPHA, ['I'] = CC_ALPHA, ['J'] = CC_ALPHA,
+    ['K'] = CC_ALPHA, ['L'] = CC_ALPHA, ['M'] = CC_ALPHA, ['N'] = CC_ALPHA, ['O'] = CC_ALPHA,
+    ['P'] = CC_ALPHA, ['Q'] = CC_ALPHA, ['R'] = CC_ALPHA, ['S'] = CC_ALPHA, ['T'] = CC_ALPHA,
+    ['U'] = CC_ALPHA, ['V'] = CC_ALPHA, ['W'] = CC_ALPHA, ['X'] = CC_ALPHA, ['Y'] = CC_ALPHA,
+    ['Z'] = CC_ALPHA,
+};
+
+static inline bool is_class(int c, uint8_t cls) {
+    return (char_class[(unsigned char)c] & cls) != 0;
+}
+
+static inline bool is_blank(int c) {
+    return is_class(c, CC_BLANK);
+}
+
+// Returns the first byte in [ptr, end) that isn't a space, tab or line break, or end.
+static const char *find_non_blank(const char *ptr, const char *end) {
+#if defined(PARSE_SIMD)
+    const vec_t sp = vec_set(' ');
+    const vec_t tab = vec_set('\t');
+    const vec_t cr = vec_set('\r');
+    const vec_t nl = vec_set('\n');
+    while(end - ptr >= PARSE_SIMD) {
+        vec_t v = vec_load(ptr);
+        vec_t blank = vec_or(vec_or(vec_eq(v, sp), vec_eq(v, tab)),
+                             vec_or(vec_eq(v, cr), vec_eq(v, nl)));
+        uint32_t mask = ~vec_mask(blank);
+#if PARSE_SIMD < 32
+        mask &= (1u << PARSE_SIMD) - 1;
+#endif
+        if(mask) return ptr + ctz32(mask);
+        ptr += PARSE_SIMD;
+    }
+#endif
+    while(ptr != end && is_blank(*ptr)) ptr += 1;
+    return ptr;
+}
+
+// Same as find_non_blank, for padded buffers: the NUL at the end isn't blank, so it stops every
+// loop without a bounds check, and vector loads can run past it into the padding.
+static const char *find_non_blank_padded(const char *ptr) {
+#if defined(PARSE_SIMD)
+    const vec_t sp = vec_set(' ');
+    const vec_t tab = vec_set('\t');
+    const vec_t cr = vec_set('\r');
+    const vec_t nl = vec_set('\n');
     for(;;) {
-        int c = advance(parser);
-        if(!is_tok_char(c)) break;
-        len += 1;
-        switch(state) {
-        case STATE_INT:
-            if(c == '.') state = STATE_FLOAT;
-            else if(!isdigit(c)) state = STATE_TEXT;
-            break;
-            
-        case STATE_FLOAT:
-            if(c == 'E' || c == 'e') state = STATE_EXP_SIGN;
-            else if(!isdigit(c)) state = STATE_TEXT;
-            break;
-            
-        case STATE_EXP_SIGN:
-            if(c == '+' || c == '-') state = STATE_EXP;
-            else state = STATE_TEXT;
-            break;
-            
-        case STATE_EXP:
-            if(!isdigit(c)) state = STATE_TEXT;
-            break;
-            
-        case STATE_TEXT:
-            break;
-            
-            default: break;
-        }
+        vec_t v = vec_load(ptr);
+        vec_t blank = vec_or(vec_or(vec_eq(v, sp), vec_eq(v, tab)),
+                             vec_or(vec_eq(v, cr), vec_eq(v, nl)));
+        uint32_t mask = ~vec_mask(blank);
+#if PARSE_SIMD < 32
+        mask &= (1u << PARSE_SIMD) - 1;
+#endif
+        if(mask) return ptr + ctz32(mask);
+        ptr += PARSE_SIMD;
     }
-    
-    switch(state) {
-    case STATE_INT: parser->tok.kind = TOK_INT; break;
-    case STATE_FLOAT:
-    case STATE_EXP: parser->tok.kind = TOK_FLOAT; break;
-    default: parser->tok.kind = TOK_TEXT; break;
+#else
+    while(is_blank(*ptr)) ptr += 1;
+    return ptr;
+#endif
+}
+
+// Moves the cursor to [to], counting the line breaks skipped over to keep line/column right.
+static void skip_to(parser_t *parser, const char *to) {
+    if(parser->lazy_pos) {
+        parser->ptr = to;
+        return;
     }
-    parser->tok.len = len;
-    
-    if(parser->tok.kind == TOK_INT) {
-        parser->tok.i64 = atol(parser->tok.start);
-    } else if(parser->tok.kind == TOK_FLOAT) {
-        parser->tok.f64 = atof(parser->tok.start);
+    const char *ptr = parser->ptr;
+    const char *nl;
+    while((nl = memchr(ptr, '\n', to - ptr))) {
+        parser->line += 1;
+        parser->column = 1;
+        ptr = nl + 1;
     }
-    
-    return &parser->tok;
+    parser->column += to - ptr;
+    parser->ptr = to;
 }
 
-const tok_t *lex(parser_t *parser) {
-    if(parser->error) return &parser->tok;
-    
-    skip_whitespace(parser);
-    parser->tok.start = parser->ptr;
-    parser->tok.line = parser->line;
-    parser->tok.column = parser->column;
-    
-    int c = peek(parser);
-    
-    if(c == EOF) {
-        parser->tok.kind = TOK_EOF;
-        return &parser->tok;
-    }
-    
-    if(is_tok_char(c)) {
-        return make_token(parser);
+// Whitespace and comments are skipped in bulk, and only fall back to peek() at the end of
+// the buffer so that streaming parsers get refilled. Skipped bytes are never carried over a
+// refill, so tok.start follows the cursor.
+static void skip_whitespace(parser_t *parser) {
+    for(;;) {
+        skip_to(parser, parser->padded
+            ? find_non_blank_padded(parser->ptr)
+            : find_non_blank(parser->ptr, parser->end));
+        parser->tok.start = parser->ptr;
+        
+        int c = peek(parser);
+        if(parser->error || c == EOF) return;
+        if(is_blank(c)) continue;
+        if(!is_class(c, CC_COMMENT)) return;
+        
+        // Comments run to the next line break, which the blank skip above then consumes.
+        for(;;) {
+            const char *nl = memchr(parser->ptr, '\n', parser->end - parser->ptr);
+            skip_to(parser, nl ? nl : parser->end);
+            parser->tok.start = parser->ptr;
+            if(nl || peek(parser) == EOF || parser->error) break;
+        }
     }
-    
-    parser->tok.kind = TOK_INVALID;
-    return &parser->tok;
 }
 
-bool have(parser_t *parser, tok_kind_t kind) {
-    PARSE_ASSERT(parser != NULL);
-    return parser->tok.kind == kind;
+static inline int popcount32(uint32_t x) {
+#if defined(_MSC_VER)
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+    return __builtin_popcount(x);
+#endif
 }
 
-bool match(parser_t *parser, tok_kind_t kind) {
-    PARSE_ASSERT(parser != NULL);
-    if(!have(parser, kind)) return false;
-    (void)lex(parser);
-    return true;
+static size_t count_newlines(const char *ptr, const char *end) {
+    size_t count = 0;
+#if defined(PARSE_SIMD)
+    const vec_t nl = vec_set('\n');
+    for(; end - ptr >= PARSE_SIMD; ptr += PARSE_SIMD) {
+        count += popcount32(vec_mask(vec_eq(vec_load(ptr), nl)));
+    }
+#endif
+    for(; ptr != end; ++ptr) {
+        count += *ptr == '\n';
+    }
+    return count;
 }
 
-static const char *tok_name(tok_kind_t kind) {
-    switch(kind) {
-        case TOK_INVALID: return "an invalid token";
-        case TOK_EOF: return "the end of file";
-        case TOK_INT: return "an integer";
-        case TOK_FLOAT: return "a number";
-        case TOK_TEXT: return "a word";
+// Size of the blocks of the newline index.
+#define NL_BLOCK (4096)
+
+// Extends the newline index up to [block]: nl_index[i] counts the line breaks between pos_base
+// and the start of block i.
+static void index_newlines(parser_t *parser, size_t block) {
+    if(block >= parser->nl_cap) {
+        size_t cap = parser->nl_cap ? parser->nl_cap : 64;
+        while(cap <= block) cap *= 2;
+        
+        uint32_t *index = alloc_in(parser, cap, sizeof(uint32_t));
+        PARSE_ASSERT(index);
+        if(parser->nl_index) {
+            memcpy(index, parser->nl_index, parser->nl_blocks * sizeof(uint32_t));
+            free_in(parser, parser->nl_index);
+        }
+        parser->nl_index = index;
+        parser->nl_cap = cap;
     }
-    return "<bad token kind>";
+    
+    if(!parser->nl_blocks) parser->nl_index[parser->nl_blocks++] = 0;
+    for(size_t i = parser->nl_blocks; i <= block; ++i) {
+        const char *start = parser->pos_base + (i - 1) * NL_BLOCK;
+        parser->nl_index[i] = parser->nl_index[i - 1]
+            + (uint32_t)count_newlines(start, start + NL_BLOCK);
+    }
+    if(block >= parser->nl_blocks) parser->nl_blocks = block + 1;
 }
 
-void syntax_error(parser_t *parser, tok_kind_t kind) {
+void parse_locate(parser_t *parser, const char *at, int *line, int *column) {
     PARSE_ASSERT(parser != NULL);
-    if(parser->error) return;
+    PARSE_ASSERT(at >= parser->pos_base && at <= parser->end);
+    
+    const char *base = parser->pos_base;
+    size_t block = (at - base) / NL_BLOCK;
+    index_newlines(parser, block);
+    size_t lines = parser->nl_index[block] + count_newlines(base + block * NL_BLOCK, at);
     
-    parse_fail(parser, "found %s, but needed %s",
-        tok_name(parser->tok.kind), tok_name(kind));
+    const char *start = at;
+    while(start != base && start[-1] != '\n') start -= 1;
+    
+    if(line) *line = parser->base_line + (int)lines;
+    if(column) *column = (lines ? 1 : parser->base_column) + (int)(at - start);
 }
 
-void expect(parser_t *parser, tok_kind_t kind) {
+void parse_lazy_positions(parser_t *parser, bool lazy) {
     PARSE_ASSERT(parser != NULL);
-    if(parser->error) return;
-    if(!have(parser, kind)) {
-        syntax_error(parser, kind);
-        return;
+    if(parser->lazy_pos && !lazy) {
+        parse_locate(parser, parser->ptr, &parser->line, &parser->column);
     }
-    lex(parser);
+    parser->lazy_pos = lazy;
 }
 
-int64_t parse_int(parser_t *parser) {
-    PARSE_ASSERT(parser != NULL);
-    if(parser->error) return 0;
-    if(!have(parser, TOK_INT)) {
-        syntax_error(parser, TOK_INT);
+// Records the position of [keep], which a stream refill is about to move to the start of the
+// window, dropping everything before it.
+static void rebase_positions(parser_t *parser, const char *keep) {
+    if(parser->lazy_pos) {
+        parse_locate(parser, keep, &parser->base_line, &parser->base_column);
+    } else {
+        // There's no line break between [keep] and the cursor: [keep] is either the cursor, or
+        // the start of the token being scanned.
+        parser->base_line = parser->line;
+        parser->base_column = parser->column - (int)(parser->ptr - keep);
     }
-    int64_t val = parser->tok.i64;
-    lex(parser);
-    return val;
+    parser->nl_blocks = 0;
 }
 
-double parse_float(parser_t *parser) {
-    PARSE_ASSERT(parser != NULL);
-    if(parser->error) return 0;
+static inline bool is_tok_char(int c) {
+    return is_class(c, CC_TOK);
+}
+
+#if defined(PARSE_SIMD)
+// Converts 8 ASCII digits at once (SWAR, little-endian, which every target of PARSE_SIMD is).
+static inline uint64_t eight_digits(const char *ptr) {
+    uint64_t v;
+    memcpy(&v, ptr, sizeof(v));
+    v -= UINT64_C(0x3030303030303030);
+    v = (v * 10) + (v >> 8);
+    v = (((v & UINT64_C(0x000000FF000000FF)) * (100 + (UINT64_C(1000000) << 32)))
+        + (((v >> 16) & UINT64_C(0x000000FF000000FF)) * (1 + (UINT64_C(10000) << 32)))) >> 32;
+    return v;
+}
+#endif
+
+// Converts a run of [count] digits. Past leading zeros, anything longer than 19 digits can't fit
+// in an int64_t, so we don't bother converting it.
+static bool digits_value(const char *ptr, size_t count, uint64_t *value) {
+    while(count && *ptr == '0') {
+        ptr += 1;
+        count -= 1;
+    }
+    if(count > 19) return false;
+    
+    uint64_t v = 0;
+#if defined(PARSE_SIMD)
+    for(; count >= 8; count -= 8, ptr += 8) {
+        v = v * 100000000 + eight_digits(ptr);
+    }
+#endif
+    for(; count; count -= 1, ptr += 1) {
+        v = v * 10 + (*ptr - '0');
+    }
+    *value = v;
+    return true;
+}
+
+// Converts a token that the lexer classified as an integer, failing if it doesn't fit in an
+// int64_t.
+static bool int_value(const char *ptr, size_t len, int64_t *value) {
+    bool negative = false;
+    if(is_class(*ptr, CC_SIGN)) {
+        negative = *ptr == '-';
+        ptr += 1;
+        len -= 1;
+    }
+    
+    uint64_t magnitude = 0;
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if(!digits_value(ptr, len, &magnitude) || magnitude > limit) return false;
+    *value = negative && magnitude ? -(int64_t)(magnitude - 1) - 1 : (int64_t)magnitude;
+    return true;
+}
+
+static int64_t convert_int(parser_t *parser) {
+    int64_t value;
+    if(!int_value(parser->tok.start, parser->tok.len, &value)) {
+        parse_range_error(parser);
+        return 0;
+    }
+    return value;
+}
+
+// Powers of ten that are exact as doubles.
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Clinger's fast path: when the mantissa and the power of ten are both exact doubles, a single
+// IEEE multiplication or division is correctly rounded. It can't be trusted when intermediate
+// results are kept in extended precision (x87), so those targets always take the slow path.
+static bool fast_float(uint64_t mantissa, int64_t exp10, double *out) {
+#if FLT_EVAL_METHOD == 0
+    const uint64_t max_exact = UINT64_C(1) << 53;
+    if(mantissa > max_exact) return false;
+    
+    if(exp10 < 0) {
+        if(exp10 < -22) return false;
+        *out = (double)mantissa / exact_pow10[-exp10];
+        return true;
+    }
+    // Large exponents can still be exact if we can move some of them into the mantissa.
+    for(; exp10 > 22; exp10 -= 1) {
+        if(mantissa > max_exact / 10) return false;
+        mantissa *= 10;
+    }
+    *out = (double)mantissa * exact_pow10[exp10];
+    return true;
+#else
+    (void)mantissa;
+    (void)exp10;
+    (void)out;
+    return false;
+#endif
+}
+
+// Powers of five from 5^-342 to 5^308, normalised to 128 bits (top bit set), as {high, low}.
+// Positive powers are truncated, negative ones rounded up: this is the table the Eisel-Lemire
+// proofs assume.
+#define POW5_MIN (-342)
+#define POW5_MAX 308
+
+static const uint64_t pow5_128[][2] = {
+    {0xeef453d6923bd65a, 0x113faa2906a13b3f}, {0x9558b4661b6565f8, 0x4ac7ca59a424c507},
+    {0xbaaee17fa23ebf76, 0x5d79bcf00d2df649}, {0xe95a99df8ace6f53, 0xf4d82c2c107973dc},
+    {0x91d8a02bb6c10594, 0x79071b9b8a4be869}, {0xb64ec836a47146f9, 0x9748e2826cdee284},
+    {0xe3e27a444d8d98b7, 0xfd1b1b2308169b25}, {0x8e6d8c6ab0787f72, 0xfe30f0f5e50e20f7},
+    {0xb208ef855c969f4f, 0xbdbd2d335e51a935}, {0xde8b2b66b3bc4723, 0xad2c788035e61382},
+    {0x8b16fb203055ac76, 0x4c3bcb5021afcc31}, {0xaddcb9e83c6b1793, 0xdf4abe242a1bbf3d},
+    {0xd953e8624b85dd78, 0xd71d6dad34a2af0d}, {0x87d4713d6f33aa6b, 0x8672648c40e5ad68},
+    {0xa9c98d8ccb009506, 0x680efdaf511f18c2}, {0xd43bf0effdc0ba48, 0x0212bd1b2566def2},
+    {0x84a57695fe98746d, 0x014bb630f7604b57}, {0xa5ced43b7e3e9188, 0x419ea3bd35385e2d},
+    {0xcf42894a5dce35ea, 0x52064cac828675b9}, {0x818995ce7aa0e1b2, 0x7343efebd1940993},
+    {0xa1ebfb4219491a1f, 0x1014ebe6c5f90bf8}, {0xca66fa129f9b60a6, 0xd41a26e077774ef6},
+    {0xfd00b897478238d0, 0x8920b098955522b4}, {0x9e20735e8cb16382, 0x55b46e5f5d5535b0},
+    {0xc5a890362fddbc62, 0xeb2189f734aa831d}, {0xf712b443bbd52b7b, 0xa5e9ec7501d523e4},
+    {0x9a6bb0aa55653b2d, 0x47b233c92125366e}, {0xc1069cd4eabe89f8, 0x999ec0bb696e840a},
+    {0xf148440a256e2c76, 0xc00670ea43ca250d}, {0x96cd2a865764dbca, 0x380406926a5e5728},
+    {0xbc807527ed3e12bc, 0xc605083704f5ecf2}, {0xeba09271e88d976b, 0xf7864a44c633682e},
+    {0x93445b8731587ea3, 0x7ab3ee6afbe0211d}, {0xb8157268fdae9e4c, 0x5960ea05bad82964},
+    {0xe61acf033d1a45df, 0x6fb92487298e33bd}, {0x8fd0c16206306bab, 0xa5d3b6d479f8e056},
+    {0xb3c4f1ba87bc8696, 0x8f48a4899877186c}, {0xe0b62e2929aba83c, 0x331acdabfe94de87},
+    {0x8c71dcd9ba0b4925, 0x9ff0c08b7f1d0b14}, {0xaf8e5410288e1b6f, 0x07ecf0ae5ee44dd9},
+    {0xdb71e91432b1a24a, 0xc9e82cd9f69d6150}, {0x892731ac9faf056e, 0xbe311c083a225cd2},
+    {0xab70fe17c79ac6ca, 0x6dbd630a48aaf406}, {0xd64d3d9db981787d, 0x092cbbccdad5b108},
+    {0x85f0468293f0eb4e, 0x25bbf56008c58ea5}, {0xa76c582338ed2621, 0xaf2af2b80af6f24e},
+    {0xd1476e2c07286faa, 0x1af5af660db4aee1}, {0x82cca4db847945ca, 0x50d98d9fc890ed4d},
+    {0xa37fce126597973c, 0xe50ff107bab528a0}, {0xcc5fc196fefd7d0c, 0x1e53ed49a96272c8},
+    {0xff77b1fcbebcdc4f, 0x25e8e89c13bb0f7a}, {0x9faacf3df73609b1, 0x77b191618c54e9ac},
+    {0xc795830d75038c1d, 0xd59df5b9ef6a2417}, {0xf97ae3d0d2446f25, 0x4b0573286b44ad1d},
+    {0x9becce62836ac577, 0x4ee367f9430aec32}, {0xc2e801fb244576d5, 0x229c41f793cda73f},
+    {0xf3a20279ed56d48a, 0x6b43527578c1110f}, {0x9845418c345644d6, 0x830a13896b78aaa9},
+    {0xbe5691ef416bd60c, 0x23cc986bc656d553}, {0xedec366b11c6cb8f, 0x2cbfbe86b7ec8aa8},
+    {0x94b3a202eb1c3f39, 0x7bf7d71432f3d6a9}, {0xb9e08a83a5e34f07, 0xdaf5ccd93fb0cc53},
+    {0xe858ad248f5c22c9, 0xd1b3400f8f9cff68}, {0x91376c36d99995be, 0x23100809b9c21fa1},
+    {0xb58547448ffffb2d, 0xabd40a0c2832a78a}, {0xe2e69915b3fff9f9, 0x16c90c8f323f516c},
+    {0x8dd01fad907ffc3b, 0xae3da7d97f6792e3}, {0xb1442798f49ffb4a, 0x99cd11cfdf41779c},
+    {0xdd95317f31c7fa1d, 0x40405643d711d583}, {0x8a7d3eef7f1cfc52, 0x482835ea666b2572},
+    {0xad1c8eab5ee43b66, 0xda3243650005eecf}, {0xd863b256369d4a40, 0x90bed43e40076a82},
+    {0x873e4f75e2224e68, 0x5a7744a6e804a291}, {0xa90de3535aaae202, 0x711515d0a205cb36},
+    {0xd3515c2831559a83, 0x0d5a5b44ca873e03}, {0x8412d9991ed58091, 0xe858790afe9486c2},
+    {0xa5178fff668ae0b6, 0x626e974dbe39a872}, {0xce5d73ff402d98e3, 0xfb0a3d212dc8128f},
+    {0x80fa687f881c7f8e, 0x7ce66634bc9d0b99}, {0xa139029f6a239f72, 0x1c1fffc1ebc44e80},
+    {0xc987434744ac874e, 0xa327ffb266b56220}, {0xfbe9141915d7a922, 0x4bf1ff9f0062baa8},
+    {0x9d71ac8fada6c9b5, 0x6f773fc3603db4a9}, {0xc4ce17b399107c22, 0xcb550fb4384d21d3},
+    {0xf6019da07f549b2b, 0x7e2a53a146606a48}, {0x99c102844f94e0fb, 0x2eda7444cbfc426d},
+    {0xc0314325637a1939, 0xfa911155fefb5308}, {0xf03d93eebc589f88, 0x793555ab7eba27ca},
+    {0x96267c7535b763b5, 0x4bc1558b2f3458de}, {0xbbb01b9283253ca2, 0x9eb1aaedfb016f16},
+    {0xea9c227723ee8bcb, 0x465e15a979c1cadc}, {0x92a1958a7675175f, 0x0bfacd89ec191ec9},
+    {0xb749faed14125d36, 0xcef980ec671f667b}, {0xe51c79a85916f484, 0x82b7e12780e7401a},
+    {0x8f31cc0937ae58d2, 0xd1b2ecb8b0908810}, {0xb2fe3f0b8599ef07, 0x861fa7e6dcb4aa15},
+    {0xdfbdcece67006ac9, 0x67a791e093e1d49a}, {0x8bd6a141006042bd, 0xe0c8bb2c5c6d24e0},
+    {0xaecc49914078536d, 0x58fae9f773886e18}, {0xda7f5bf590966848, 0xaf39a475506a899e},
+    {0x888f99797a5e012d, 0x6d8406c952429603}, {0xaab37fd7d8f58178, 0xc8e5087ba6d33b83},
+    {0xd5605fcdcf32e1d6, 0xfb1e4a9a90880a64}, {0x855c3be0a17fcd26, 0x5cf2eea09a55067f},
+    {0xa6b34ad8c9dfc06f, 0xf42faa48c0ea481e}, {0xd0601d8efc57b08b, 0xf13b94daf124da26},
+    {0x823c12795db6ce57, 0x76c53d08d6b70858}, {0xa2cb1717b52481ed, 0x54768c4b0c64ca6e},
+    {0xcb7ddcdda26da268, 0xa9942f5dcf7dfd09}, {0xfe5d54150b090b02, 0xd3f93b35435d7c4c},
+    {0x9efa548d26e5a6e1, 0xc47bc5014a1a6daf}, {0xc6b8e9b0709f109a, 0x359ab6419ca1091b},
+    {0xf867241c8cc6d4c0, 0xc30163d203c94b62}, {0x9b407691d7fc44f8, 0x79e0de63425dcf1d},
+    {0xc21094364dfb5636, 0x985915fc12f542e4}, {0xf294b943e17a2bc4, 0x3e6f5b7b17b2939d},
+    {0x979cf3ca6cec5b5a, 0xa705992ceecf9c42}, {0xbd8430bd08277231, 0x50c6ff782a838353},
+    {0xece53cec4a314ebd, 0xa4f8bf5635246428}, {0x940f4613ae5ed136, 0x871b7795e136be99},
+    {0xb913179899f68584, 0x28e2557b59846e3f}, {0xe757dd7ec07426e5, 0x331aeada2fe589cf},
+    {0x9096ea6f3848984f, 0x3ff0d2c85def7621}, {0xb4bca50b065abe63, 0x0fed077a756b53a9},
+    {0xe1ebce4dc7f16dfb, 0xd3e8495912c62894}, {0x8d3360f09cf6e4bd, 0x64712dd7abbbd95c},
+    {0xb080392cc4349dec, 0xbd8d794d96aacfb3}, {0xdca04777f541c567, 0xecf0d7a0fc5583a0},
+    {0x89e42caaf9491b60, 0xf41686c49db57244}, {0xac5d37d5b79b6239, 0x311c2875c522ced5},
+    {0xd77485cb25823ac7, 0x7d633293366b828b}, {0x86a8d39ef77164bc, 0xae5dff9c02033197},
+    {0xa8530886b54dbdeb, 0xd9f57f830283fdfc}, {0xd267caa862a12d66, 0xd072df63c324fd7b},
+    {0x8380dea93da4bc60, 0x4247cb9e59f71e6d}, {0xa46116538d0deb78, 0x52d9be85f074e608},
+    {0xcd795be870516656, 0x67902e276c921f8b}, {0x806bd9714632dff6, 0x00ba1cd8a3db53b6},
+    {0xa086cfcd97bf97f3, 0x80e8a40eccd228a4}, {0xc8a883c0fdaf7df0, 0x6122cd128006b2cd},
+    {0xfad2a4b13d1b5d6c, 0x796b805720085f81}, {0x9cc3a6eec6311a63, 0xcbe3303674053bb0},
+    {0xc3f490aa77bd60fc, 0xbedbfc4411068a9c}, {0xf4f1b4d515acb93b, 0xee92fb5515482d44},
+    {0x991711052d8bf3c5, 0x751bdd152d4d1c4a}, {0xbf5cd54678eef0b6, 0xd262d45a78a0635d},
+    {0xef340a98172aace4, 0x86fb897116c87c34}, {0x9580869f0e7aac0e, 0xd45d35e6ae3d4da0},
+    {0xbae0a846d2195712, 0x8974836059cca109}, {0xe998d258869facd7, 0x2bd1a438703fc94b},
+    {0x91ff83775423cc06, 0x7b6306a34627ddcf}, {0xb67f6455292cbf08, 0x1a3bc84c17b1d542},
+    {0xe41f3d6a7377eeca, 0x20caba5f1d9e4a93}, {0x8e938662882af53e, 0x547eb47b7282ee9c},
+    {0xb23867fb2a35b28d, 0xe99e619a4f23aa43}, {0xdec681f9f4c31f31, 0x6405fa00e2ec94d4},
+    {0x8b3c113c38f9f37e, 0xde83bc408dd3dd04}, {0xae0b158b4738705e, 0x9624ab50b148d445},
+    {0xd98ddaee19068c76, 0x3badd624dd9b0957}, {0x87f8a8d4cfa417c9, 0xe54ca5d70a80e5d6},
+    {0xa9f6d30a038d1dbc, 0x5e9fcf4ccd211f4c}, {0xd47487cc8470652b, 0x7647c3200069671f},
+    {0x84c8d4dfd2c63f3b, 0x29ecd9f40041e073}, {0xa5fb0a17c777cf09, 0xf468107100525890},
+    {0xcf79cc9db955c2cc, 0x7182148d4066eeb4}, {0x81ac1fe293d599bf, 0xc6f14cd848405530},
+    {0xa21727db38cb002f, 0xb8ada00e5a506a7c}, {0xca9cf1d206fdc03b, 0xa6d90811f0e4851c},
+    {0xfd442e4688bd304a, 0x908f4a166d1da663}, {0x9e4a9cec15763e2e, 0x9a598e4e043287fe},
+    {0xc5dd44271ad3cdba, 0x40eff1e1853f29fd}, {0xf7549530e188c128, 0xd12bee59e68ef47c},
+    {0x9a94dd3e8cf578b9, 0x82bb74f8301958ce}, {0xc13a148e3032d6e7, 0xe36a52363c1faf01},
+    {0xf18899b1bc3f8ca1, 0xdc44e6c3cb279ac1}, {0x96f5600f15a7b7e5, 0x29ab103a5ef8c0b9},
+    {0xbcb2b812db11a5de, 0x7415d448f6b6f0e7}, {0xebdf661791d60f56, 0x111b495b3464ad21},
+    {0x936b9fcebb25c995, 0xcab10dd900beec34}, {0xb84687c269ef3bfb, 0x3d5d514f40eea742},
+    {0xe65829b3046b0afa, 0x0cb4a5a3112a5112}, {0x8ff71a0fe2c2e6dc, 0x47f0e785eaba72ab},
+    {0xb3f4e093db73a093, 0x59ed216765690f56}, {0xe0f218b8d25088b8, 0x306869c13ec3532c},
+    {0x8c974f7383725573, 0x1e414218c73a13fb}, {0xafbd2350644eeacf, 0xe5d1929ef90898fa},
+    {0xdbac6c247d62a583, 0xdf45f746b74abf39}, {0x894bc396ce5da772, 0x6b8bba8c328eb783},
+    {0xab9eb47c81f5114f, 0x066ea92f3f326564}, {0xd686619ba27255a2, 0xc80a537b0efefebd},
+    {0x8613fd0145877585, 0xbd06742ce95f5f36}, {0xa798fc4196e952e7, 0x2c48113823b73704},
+    {0xd17f3b51fca3a7a0, 0xf75a15862ca504c5}, {0x82ef85133de648c4, 0x9a984d73dbe722fb},
+    {0xa3ab66580d5fdaf5, 0xc13e60d0d2e0ebba}, {0xcc963fee10b7d1b3, 0x318df905079926a8},
+    {0xffbbcfe994e5c61f, 0xfdf17746497f7052}, {0x9fd561f1fd0f9bd3, 0xfeb6ea8bedefa633},
+    {0xc7caba6e7c5382c8, 0xfe64a52ee96b8fc0}, {0xf9bd690a1b68637b, 0x3dfdce7aa3c673b0},
+    {0x9c1661a651213e2d, 0x06bea10ca65c084e}, {0xc31bfa0fe5698db8, 0x486e494fcff30a62},
+    {0xf3e2f893dec3f126, 0x5a89dba3c3efccfa}, {0x986ddb5c6b3a76b7, 0xf89629465a75e01c},
+    {0xbe89523386091465, 0xf6bbb397f1135823}, {0xee2ba6c0678b597f, 0x746aa07ded582e2c},
+    {0x94db483840b717ef, 0xa8c2a44eb4571cdc}, {0xba121a4650e4ddeb, 0x92f34d62616ce413},
+    {0xe896a0d7e51e1566, 0x77b020baf9c81d17}, {0x915e2486ef32cd60, 0x0ace1474dc1d122e},
+    {0xb5b5ada8aaff80b8, 0x0d819992132456ba}, {0xe3231912d5bf60e6, 0x10e1fff697ed6c69},
+    {0x8df5efabc5979c8f, 0xca8d3ffa1ef463c1}, {0xb1736b96b6fd83b3, 0xbd308ff8a6b17cb2},
+    {0xddd0467c64bce4a0, 0xac7cb3f6d05ddbde}, {0x8aa22c0dbef60ee4, 0x6bcdf07a423aa96b},
+    {0xad4ab7112eb3929d, 0x86c16c98d2c953c6}, {0xd89d64d57a607744, 0xe871c7bf077ba8b7},
+    {0x87625f056c7c4a8b, 0x11471cd764ad4972}, {0xa93af6c6c79b5d2d, 0xd598e40d3dd89bcf},
+    {0xd389b47879823479, 0x4aff1d108d4ec2c3}, {0x843610cb4bf160cb, 0xcedf722a585139ba},
+    {0xa54394fe1eedb8fe, 0xc2974eb4ee658828}, {0xce947a3da6a9273e, 0x733d226229feea32},
+    {0x811ccc668829b887, 0x0806357d5a3f525f}, {0xa163ff802a3426a8, 0xca07c2dcb0cf26f7},
+    {0xc9bcff6034c13052, 0xfc89b393dd02f0b5}, {0xfc2c3f3841f17c67, 0xbbac2078d443ace2},
+    {0x9d9ba7832936edc0, 0xd54b944b84aa4c0d}, {0xc5029163f384a931, 0x0a9e795e65d4df11},
+    {0xf64335bcf065d37d, 0x4d4617b5ff4a16d5}, {0x99ea0196163fa42e, 0x504bced1bf8e4e45},
+    {0xc06481fb9bcf8d39, 0xe45ec2862f71e1d6}, {0xf07da27a82c37088, 0x5d767327bb4e5a4c},
+    {0x964e858c91ba2655, 0x3a6a07f8d510f86f}, {0xbbe226efb628afea, 0x890489f70a55368b},
+    {0xeadab0aba3b2dbe5, 0x2b45ac74ccea842e}, {0x92c8ae6b464fc96f, 0x3b0b8bc90012929d},
+    {0xb77ada0617e3bbcb, 0x09ce6ebb40173744}, {0xe55990879ddcaabd, 0xcc420a6a101d0515},
+    {0x8f57fa54c2a9eab6, 0x9fa946824a12232d}, {0xb32df8e9f3546564, 0x47939822dc96abf9},
+    {0xdff9772470297ebd, 0x59787e2b93bc56f7}, {0x8bfbea76c619ef36, 0x57eb4edb3c55b65a},
+    {0xaefae51477a06b03, 0xede622920b6b23f1}, {0xdab99e59958885c4, 0xe95fab368e45eced},
+    {0x88b402f7fd75539b, 0x11dbcb0218ebb414}, {0xaae103b5fcd2a881, 0xd652bdc29f26a119},
+    {0xd59944a37c0752a2, 0x4be76d3346f0495f}, {0x857fcae62d8493a5, 0x6f70a4400c562ddb},
+    {0xa6dfbd9fb8e5b88e, 0xcb4ccd500f6bb952}, {0xd097ad07a71f26b2, 0x7e2000a41346a7a7},
+    {0x825ecc24c873782f, 0x8ed400668c0c28c8}, {0xa2f67f2dfa90563b, 0x728900802f0f32fa},
+    {0xcbb41ef979346bca, 0x4f2b40a03ad2ffb9}, {0xfea126b7d78186bc, 0xe2f610c84987bfa8},
+    {0x9f24b832e6b0f436, 0x0dd9ca7d2df4d7c9}, {0xc6ede63fa05d3143, 0x91503d1c79720dbb},
+    {0xf8a95fcf88747d94, 0x75a44c6397ce912a}, {0x9b69dbe1b548ce7c, 0xc986afbe3ee11aba},
+    {0xc24452da229b021b, 0xfbe85badce996168}, {0xf2d56790ab41c2a2, 0xfae27299423fb9c3},
+    {0x97c560ba6b0919a5, 0xdccd879fc967d41a}, {0xbdb6b8e905cb600f, 0x5400e987bbc1c920},
+    {0xed246723473e3813, 0x290123e9aab23b68}, {0x9436c0760c86e30b, 0xf9a0b6720aaf6521},
+    {0xb94470938fa89bce, 0xf808e40e8d5b3e69}, {0xe7958cb87392c2c2, 0xb60b1d1230b20e04},
+    {0x90bd77f3483bb9b9, 0xb1c6f22b5e6f48c2}, {0xb4ecd5f01a4aa828, 0x1e38aeb6360b1af3},
+    {0xe2280b6c20dd5232, 0x25c6da63c38de1b0}, {0x8d590723948a535f, 0x579c487e5a38ad0e},
+    {0xb0af48ec79ace837, 0x2d835a9df0c6d851}, {0xdcdb1b2798182244, 0xf8e431456cf88e65},
+    {0x8a08f0f8bf0f156b, 0x1b8e9ecb641b58ff}, {0xac8b2d36eed2dac5, 0xe272467e3d222f3f},
+    {0xd7adf884aa879177, 0x5b0ed81dcc6abb0f}, {0x86ccbb52ea94baea, 0x98e947129fc2b4e9},
+    {0xa87fea27a539e9a5, 0x3f2398d747b36224}, {0xd29fe4b18e88640e, 0x8eec7f0d19a03aad},
+    {0x83a3eeeef9153e89, 0x1953cf68300424ac}, {0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7},
+    {0xcdb02555653131b6, 0x3792f412cb06794d}, {0x808e17555f3ebf11, 0xe2bbd88bbee40bd0},
+    {0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4}, {0xc8de047564d20a8b, 0xf245825a5a445275},
+    {0xfb158592be068d2e, 0xeed6e2f0f0d56712}, {0x9ced737bb6c4183d, 0x55464dd69685606b},
+    {0xc428d05aa4751e4c, 0xaa97e14c3c26b886}, {0xf53304714d9265df, 0xd53dd99f4b3066a8},
+    {0x993fe2c6d07b7fab, 0xe546a8038efe4029}, {0xbf8fdb78849a5f96, 0xde98520472bdd033},
+    {0xef73d256a5c0f77c, 0x963e66858f6d4440}, {0x95a8637627989aad, 0xdde7001379a44aa8},
+    {0xbb127c53b17ec159, 0x5560c018580d5d52}, {0xe9d71b689dde71af, 0xaab8f01e6e10b4a6},
+    {0x9226712162ab070d, 0xcab3961304ca70e8}, {0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22},
+    {0xe45c10c42a2b3b05, 0x8cb89a7db77c506a}, {0x8eb98a7a9a5b04e3, 0x77f3608e92adb242},
+    {0xb267ed1940f1c61c, 0x55f038b237591ed3}, {0xdf01e85f912e37a3, 0x6b6c46dec52f6688},
+    {0x8b61313bbabce2c6, 0x2323ac4b3b3da015}, {0xae397d8aa96c1b77, 0xabec975e0a0d081a},
+    {0xd9c7dced53c72255, 0x96e7bd358c904a21}, {0x881cea14545c7575, 0x7e50d64177da2e54},
+    {0xaa242499697392d2, 0xdde50bd1d5d0b9e9}, {0xd4ad2dbfc3d07787, 0x955e4ec64b44e864},
+    {0x84ec3c97da624ab4, 0xbd5af13bef0b113e}, {0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e},
+    {0xcfb11ead453994ba, 0x67de18eda5814af2}, {0x81ceb32c4b43fcf4, 0x80eacf948770ced7},
+    {0xa2425ff75e14fc31, 0xa1258379a94d028d}, {0xcad2f7f5359a3b3e, 0x096ee45813a04330},
+    {0xfd87b5f28300ca0d, 0x8bca9d6e188853fc}, {0x9e74d1b791e07e48, 0x775ea264cf55347e},
+    {0xc612062576589dda, 0x95364afe032a819e}, {0xf79687aed3eec551, 0x3a83ddbd83f52205},
+    {0x9abe14cd44753b52, 0xc4926a9672793543}, {0xc16d9a0095928a27, 0x75b7053c0f178294},
+    {0xf1c90080baf72cb1, 0x5324c68b12dd6339}, {0x971da05074da7bee, 0xd3f6fc16ebca5e04},
+    {0xbce5086492111aea, 0x88f4bb1ca6bcf585}, {0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6},
+    {0x9392ee8e921d5d07, 0x3aff322e62439fd0}, {0xb877aa3236a4b449, 0x09befeb9fad487c3},
+    {0xe69594bec44de15b, 0x4c2ebe687989a9b4}, {0x901d7cf73ab0acd9, 0x0f9d37014bf60a11},
+    {0xb424dc35095cd80f, 0x538484c19ef38c95}, {0xe12e13424bb40e13, 0x2865a5f206b06fba},
+    {0x8cbccc096f5088cb, 0xf93f87b7442e45d4}, {0xafebff0bcb24aafe, 0xf78f69a51539d749},
+    {0xdbe6fecebdedd5be, 0xb573440e5a884d1c}, {0x89705f4136b4a597, 0x31680a88f8953031},
+    {0xabcc77118461cefc, 0xfdc20d2b36ba7c3e}, {0xd6bf94d5e57a42bc, 0x3d32907604691b4d},
+    {0x8637bd05af6c69b5, 0xa63f9a49c2c1b110}, {0xa7c5ac471b478423, 0x0fcf80dc33721d54},
+    {0xd1b71758e219652b, 0xd3c36113404ea4a9}, {0x83126e978d4fdf3b, 0x645a1cac083126ea},
+    {0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4}, {0xcccccccccccccccc, 0xcccccccccccccccd},
+    {0x8000000000000000, 0x0000000000000000}, {0xa000000000000000, 0x0000000000000000},
+    {0xc800000000000000, 0x0000000000000000}, {0xfa00000000000000, 0x0000000000000000},
+    {0x9c40000000000000, 0x0000000000000000}, {0xc350000000000000, 0x0000000000000000},
+    {0xf424000000000000, 0x0000000000000000}, {0x9896800000000000, 0x0000000000000000},
+    {0xbebc200000000000, 0x0000000000000000}, {0xee6b280000000000, 0x0000000000000000},
+    {0x9502f90000000000, 0x0000000000000000}, {0xba43b74000000000, 0x0000000000000000},
+    {0xe8d4a51000000000, 0x0000000000000000}, {0x9184e72a00000000, 0x0000000000000000},
+    {0xb5e620f480000000, 0x0000000000000000}, {0xe35fa931a0000000, 0x0000000000000000},
+    {0x8e1bc9bf04000000, 0x0000000000000000}, {0xb1a2bc2ec5000000, 0x0000000000000000},
+    {0xde0b6b3a76400000, 0x0000000000000000}, {0x8ac7230489e80000, 0x0000000000000000},
+    {0xad78ebc5ac620000, 0x0000000000000000}, {0xd8d726b7177a8000, 0x0000000000000000},
+    {0x878678326eac9000, 0x0000000000000000}, {0xa968163f0a57b400, 0x0000000000000000},
+    {0xd3c21bcecceda100, 0x0000000000000000}, {0x84595161401484a0, 0x0000000000000000},
+    {0xa56fa5b99019a5c8, 0x0000000000000000}, {0xcecb8f27f4200f3a, 0x0000000000000000},
+    {0x813f3978f8940984, 0x4000000000000000}, {0xa18f07d736b90be5, 0x5000000000000000},
+    {0xc9f2c9cd04674ede, 0xa400000000000000}, {0xfc6f7c4045812296, 0x4d00000000000000},
+    {0x9dc5ada82b70b59d, 0xf020000000000000}, {0xc5371912364ce305, 0x6c28000000000000},
+    {0xf684df56c3e01bc6, 0xc732000000000000}, {0x9a130b963a6c115c, 0x3c7f400000000000},
+    {0xc097ce7bc90715b3, 0x4b9f100000000000}, {0xf0bdc21abb48db20, 0x1e86d40000000000},
+    {0x96769950b50d88f4, 0x1314448000000000}, {0xbc143fa4e250eb31, 0x17d955a000000000},
+    {0xeb194f8e1ae525fd, 0x5dcfab0800000000}, {0x92efd1b8d0cf37be, 0x5aa1cae500000000},
+    {0xb7abc627050305ad, 0xf14a3d9e40000000}, {0xe596b7b0c643c719, 0x6d9ccd05d0000000},
+    {0x8f7e32ce7bea5c6f, 0xe4820023a2000000}, {0xb35dbf821ae4f38b, 0xdda2802c8a800000},
+    {0xe0352f62a19e306e, 0xd50b2037ad200000}, {0x8c213d9da502de45, 0x4526f422cc340000},
+    {0xaf298d050e4395d6, 0x9670b12b7f410000}, {0xdaf3f04651d47b4c, 0x3c0cdd765f114000},
+    {0x88d8762bf324cd0f, 0xa5880a69fb6ac800}, {0xab0e93b6efee0053, 0x8eea0d047a457a00},
+    {0xd5d238a4abe98068, 0x72a4904598d6d880}, {0x85a36366eb71f041, 0x47a6da2b7f864750},
+    {0xa70c3c40a64e6c51, 0x999090b65f67d924}, {0xd0cf4b50cfe20765, 0xfff4b4e3f741cf6d},
+    {0x82818f1281ed449f, 0xbff8f10e7a8921a4}, {0xa321f2d7226895c7, 0xaff72d52192b6a0d},
+    {0xcbea6f8ceb02bb39, 0x9bf4f8a69f764490}, {0xfee50b7025c36a08, 0x02f236d04753d5b4},
+    {0x9f4f2726179a2245, 0x01d762422c946590}, {0xc722f0ef9d80aad6, 0x424d3ad2b7b97ef5},
+    {0xf8ebad2b84e0d58b, 0xd2e0898765a7deb2}, {0x9b934c3b330c8577, 0x63cc55f49f88eb2f},
+    {0xc2781f49ffcfa6d5, 0x3cbf6b71c76b25fb}, {0xf316271c7fc3908a, 0x8bef464e3945ef7a},
+    {0x97edd871cfda3a56, 0x97758bf0e3cbb5ac}, {0xbde94e8e43d0c8ec, 0x3d52eeed1cbea317},
+    {0xed63a231d4c4fb27, 0x4ca7aaa863ee4bdd}, {0x945e455f24fb1cf8, 0x8fe8caa93e74ef6a},
+    {0xb975d6b6ee39e436, 0xb3e2fd538e122b44}, {0xe7d34c64a9c85d44, 0x60dbbca87196b616},
+    {0x90e40fbeea1d3a4a, 0xbc8955e946fe31cd}, {0xb51d13aea4a488dd, 0x6babab6398bdbe41},
+    {0xe264589a4dcdab14, 0xc696963c7eed2dd1}, {0x8d7eb76070a08aec, 0xfc1e1de5cf543ca2},
+    {0xb0de65388cc8ada8, 0x3b25a55f43294bcb}, {0xdd15fe86affad912, 0x49ef0eb713f39ebe},
+    {0x8a2dbf142dfcc7ab, 0x6e3569326c784337}, {0xacb92ed9397bf996, 0x49c2c37f07965404},
+    {0xd7e77a8f87daf7fb, 0xdc33745ec97be906}, {0x86f0ac99b4e8dafd, 0x69a028bb3ded71a3},
+    {0xa8acd7c0222311bc, 0xc40832ea0d68ce0c}, {0xd2d80db02aabd62b, 0xf50a3fa490c30190},
+    {0x83c7088e1aab65db, 0x792667c6da79e0fa}, {0xa4b8cab1a1563f52, 0x577001b891185938},
+    {0xcde6fd5e09abcf26, 0xed4c0226b55e6f86}, {0x80b05e5ac60b6178, 0x544f8158315b05b4},
+    {0xa0dc75f1778e39d6, 0x696361ae3db1c721}, {0xc913936dd571c84c, 0x03bc3a19cd1e38e9},
+    {0xfb5878494ace3a5f, 0x04ab48a04065c723}, {0x9d174b2dcec0e47b, 0x62eb0d64283f9c76},
+    {0xc45d1df942711d9a, 0x3ba5d0bd324f8394}, {0xf5746577930d6500, 0xca8f44ec7ee36479},
+    {0x9968bf6abbe85f20, 0x7e998b13cf4e1ecb}, {0xbfc2ef456ae276e8, 0x9e3fedd8c321a67e},
+    {0xefb3ab16c59b14a2, 0xc5cfe94ef3ea101e}, {0x95d04aee3b80ece5, 0xbba1f1d158724a12},
+    {0xbb445da9ca61281f, 0x2a8a6e45ae8edc97}, {0xea1575143cf97226, 0xf52d09d71a3293bd},
+    {0x924d692ca61be758, 0x593c2626705f9c56}, {0xb6e0c377cfa2e12e, 0x6f8b2fb00c77836c},
+    {0xe498f455c38b997a, 0x0b6dfb9c0f956447}, {0x8edf98b59a373fec, 0x4724bd4189bd5eac},
+    {0xb2977ee300c50fe7, 0x58edec91ec2cb657}, {0xdf3d5e9bc0f653e1, 0x2f2967b66737e3ed},
+    {0x8b865b215899f46c, 0xbd79e0d20082ee74}, {0xae67f1e9aec07187, 0xecd8590680a3aa11},
+    {0xda01ee641a708de9, 0xe80e6f4820cc9495}, {0x884134fe908658b2, 0x3109058d147fdcdd},
+    {0xaa51823e34a7eede, 0xbd4b46f0599fd415}, {0xd4e5e2cdc1d1ea96, 0x6c9e18ac7007c91a},
+    {0x850fadc09923329e, 0x03e2cf6bc604ddb0}, {0xa6539930bf6bff45, 0x84db8346b786151c},
+    {0xcfe87f7cef46ff16, 0xe612641865679a63}, {0x81f14fae158c5f6e, 0x4fcb7e8f3f60c07e},
+    {0xa26da3999aef7749, 0xe3be5e330f38f09d}, {0xcb090c8001ab551c, 0x5cadf5bfd3072cc5},
+    {0xfdcb4fa002162a63, 0x73d9732fc7c8f7f6}, {0x9e9f11c4014dda7e, 0x2867e7fddcdd9afa},
+    {0xc646d63501a1511d, 0xb281e1fd541501b8}, {0xf7d88bc24209a565, 0x1f225a7ca91a4226},
+    {0x9ae757596946075f, 0x3375788de9b06958}, {0xc1a12d2fc3978937, 0x0052d6b1641c83ae},
+    {0xf209787bb47d6b84, 0xc0678c5dbd23a49a}, {0x9745eb4d50ce6332, 0xf840b7ba963646e0},
+    {0xbd176620a501fbff, 0xb650e5a93bc3d898}, {0xec5d3fa8ce427aff, 0xa3e51f138ab4cebe},
+    {0x93ba47c980e98cdf, 0xc66f336c36b10137}, {0xb8a8d9bbe123f017, 0xb80b0047445d4184},
+    {0xe6d3102ad96cec1d, 0xa60dc059157491e5}, {0x9043ea1ac7e41392, 0x87c89837ad68db2f},
+    {0xb454e4a179dd1877, 0x29babe4598c311fb}, {0xe16a1dc9d8545e94, 0xf4296dd6fef3d67a},
+    {0x8ce2529e2734bb1d, 0x1899e4a65f58660c}, {0xb01ae745b101e9e4, 0x5ec05dcff72e7f8f},
+    {0xdc21a1171d42645d, 0x76707543f4fa1f73}, {0x899504ae72497eba, 0x6a06494a791c53a8},
+    {0xabfa45da0edbde69, 0x0487db9d17636892}, {0xd6f8d7509292d603, 0x45a9d2845d3c42b6},
+    {0x865b86925b9bc5c2, 0x0b8a2392ba45a9b2}, {0xa7f26836f282b732, 0x8e6cac7768d7141e},
+    {0xd1ef0244af2364ff, 0x3207d795430cd926}, {0x8335616aed761f1f, 0x7f44e6bd49e807b8},
+    {0xa402b9c5a8d3a6e7, 0x5f16206c9c6209a6}, {0xcd036837130890a1, 0x36dba887c37a8c0f},
+    {0x802221226be55a64, 0xc2494954da2c9789}, {0xa02aa96b06deb0fd, 0xf2db9baa10b7bd6c},
+    {0xc83553c5c8965d3d, 0x6f92829494e5acc7}, {0xfa42a8b73abbf48c, 0xcb772339ba1f17f9},
+    {0x9c69a97284b578d7, 0xff2a760414536efb}, {0xc38413cf25e2d70d, 0xfef5138519684aba},
+    {0xf46518c2ef5b8cd1, 0x7eb258665fc25d69}, {0x98bf2f79d5993802, 0xef2f773ffbd97a61},
+    {0xbeeefb584aff8603, 0xaafb550ffacfd8fa}, {0xeeaaba2e5dbf6784, 0x95ba2a53f983cf38},
+    {0x952ab45cfa97a0b2, 0xdd945a747bf26183}, {0xba756174393d88df, 0x94f971119aeef9e4},
+    {0xe912b9d1478ceb17, 0x7a37cd5601aab85d}, {0x91abb422ccb812ee, 0xac62e055c10ab33a},
+    {0xb616a12b7fe617aa, 0x577b986b314d6009}, {0xe39c49765fdf9d94, 0xed5a7e85fda0b80b},
+    {0x8e41ade9fbebc27d, 0x14588f13be847307}, {0xb1d219647ae6b31c, 0x596eb2d8ae258fc8},
+    {0xde469fbd99a05fe3, 0x6fca5f8ed9aef3bb}, {0x8aec23d680043bee, 0x25de7bb9480d5854},
+    {0xada72ccc20054ae9, 0xaf561aa79a10ae6a}, {0xd910f7ff28069da4, 0x1b2ba1518094da04},
+    {0x87aa9aff79042286, 0x90fb44d2f05d0842}, {0xa99541bf57452b28, 0x353a1607ac744a53},
+    {0xd3fa922f2d1675f2, 0x42889b8997915ce8}, {0x847c9b5d7c2e09b7, 0x69956135febada11},
+    {0xa59bc234db398c25, 0x43fab9837e699095}, {0xcf02b2c21207ef2e, 0x94f967e45e03f4bb},
+    {0x8161afb94b44f57d, 0x1d1be0eebac278f5}, {0xa1ba1ba79e1632dc, 0x6462d92a69731732},
+    {0xca28a291859bbf93, 0x7d7b8f7503cfdcfe}, {0xfcb2cb35e702af78, 0x5cda735244c3d43e},
+    {0x9defbf01b061adab, 0x3a0888136afa64a7}, {0xc56baec21c7a1916, 0x088aaa1845b8fdd0},
+    {0xf6c69a72a3989f5b, 0x8aad549e57273d45}, {0x9a3c2087a63f6399, 0x36ac54e2f678864b},
+    {0xc0cb28a98fcf3c7f, 0x84576a1bb416a7dd}, {0xf0fdf2d3f3c30b9f, 0x656d44a2a11c51d5},
+    {0x969eb7c47859e743, 0x9f644ae5a4b1b325}, {0xbc4665b596706114, 0x873d5d9f0dde1fee},
+    {0xeb57ff22fc0c7959, 0xa90cb506d155a7ea}, {0x9316ff75dd87cbd8, 0x09a7f12442d588f2},
+    {0xb7dcbf5354e9bece, 0x0c11ed6d538aeb2f}, {0xe5d3ef282a242e81, 0x8f1668c8a86da5fa},
+    {0x8fa475791a569d10, 0xf96e017d694487bc}, {0xb38d92d760ec4455, 0x37c981dcc395a9ac},
+    {0xe070f78d3927556a, 0x85bbe253f47b1417}, {0x8c469ab843b89562, 0x93956d7478ccec8e},
+    {0xaf58416654a6babb, 0x387ac8d1970027b2}, {0xdb2e51bfe9d0696a, 0x06997b05fcc0319e},
+    {0x88fcf317f22241e2, 0x441fece3bdf81f03}, {0xab3c2fddeeaad25a, 0xd527e81cad7626c3},
+    {0xd60b3bd56a5586f1, 0x8a71e223d8d3b074}, {0x85c7056562757456, 0xf6872d5667844e49},
+    {0xa738c6bebb12d16c, 0xb428f8ac016561db}, {0xd106f86e69d785c7, 0xe13336d701beba52},
+    {0x82a45b450226b39c, 0xecc0024661173473}, {0xa34d721642b06084, 0x27f002d7f95d0190},
+    {0xcc20ce9bd35c78a5, 0x31ec038df7b441f4}, {0xff290242c83396ce, 0x7e67047175a15271},
+    {0x9f79a169bd203e41, 0x0f0062c6e984d386}, {0xc75809c42c684dd1, 0x52c07b78a3e60868},
+    {0xf92e0c3537826145, 0xa7709a56ccdf8a82}, {0x9bbcc7a142b17ccb, 0x88a66076400bb691},
+    {0xc2abf989935ddbfe, 0x6acff893d00ea435}, {0xf356f7ebf83552fe, 0x0583f6b8c4124d43},
+    {0x98165af37b2153de, 0xc3727a337a8b704a}, {0xbe1bf1b059e9a8d6, 0x744f18c0592e4c5c},
+    {0xeda2ee1c7064130c, 0x1162def06f79df73}, {0x9485d4d1c63e8be7, 0x8addcb5645ac2ba8},
+    {0xb9a74a0637ce2ee1, 0x6d953e2bd7173692}, {0xe8111c87c5c1ba99, 0xc8fa8db6ccdd0437},
+    {0x910ab1d4db9914a0, 0x1d9c9892400a22a2}, {0xb54d5e4a127f59c8, 0x2503beb6d00cab4b},
+    {0xe2a0b5dc971f303a, 0x2e44ae64840fd61d}, {0x8da471a9de737e24, 0x5ceaecfed289e5d2},
+    {0xb10d8e1456105dad, 0x7425a83e872c5f47}, {0xdd50f1996b947518, 0xd12f124e28f77719},
+    {0x8a5296ffe33cc92f, 0x82bd6b70d99aaa6f}, {0xace73cbfdc0bfb7b, 0x636cc64d1001550b},
+    {0xd8210befd30efa5a, 0x3c47f7e05401aa4e}, {0x8714a775e3e95c78, 0x65acfaec34810a71},
+    {0xa8d9d1535ce3b396, 0x7f1839a741a14d0d}, {0xd31045a8341ca07c, 0x1ede48111209a050},
+    {0x83ea2b892091e44d, 0x934aed0aab460432}, {0xa4e4b66b68b65d60, 0xf81da84d5617853f},
+    {0xce1de40642e3f4b9, 0x36251260ab9d668e}, {0x80d2ae83e9ce78f3, 0xc1d72b7c6b426019},
+    {0xa1075a24e4421730, 0xb24cf65b8612f81f}, {0xc94930ae1d529cfc, 0xdee033f26797b627},
+    {0xfb9b7cd9a4a7443c, 0x169840ef017da3b1}, {0x9d412e0806e88aa5, 0x8e1f289560ee864e},
+    {0xc491798a08a2ad4e, 0xf1a6f2bab92a27e2}, {0xf5b5d7ec8acb58a2, 0xae10af696774b1db},
+    {0x9991a6f3d6bf1765, 0xacca6da1e0a8ef29}, {0xbff610b0cc6edd3f, 0x17fd090a58d32af3},
+    {0xeff394dcff8a948e, 0xddfc4b4cef07f5b0}, {0x95f83d0a1fb69cd9, 0x4abdaf101564f98e},
+    {0xbb764c4ca7a4440f, 0x9d6d1ad41abe37f1}, {0xea53df5fd18d5513, 0x84c86189216dc5ed},
+    {0x92746b9be2f8552c, 0x32fd3cf5b4e49bb4}, {0xb7118682dbb66a77, 0x3fbc8c33221dc2a1},
+    {0xe4d5e82392a40515, 0x0fabaf3feaa5334a}, {0x8f05b1163ba6832d, 0x29cb4d87f2a7400e},
+    {0xb2c71d5bca9023f8, 0x743e20e9ef511012}, {0xdf78e4b2bd342cf6, 0x914da9246b255416},
+    {0x8bab8eefb6409c1a, 0x1ad089b6c2f7548e}, {0xae9672aba3d0c320, 0xa184ac2473b529b1},
+    {0xda3c0f568cc4f3e8, 0xc9e5d72d90a2741e}, {0x8865899617fb1871, 0x7e2fa67c7a658892},
+    {0xaa7eebfb9df9de8d, 0xddbb901b98feeab7}, {0xd51ea6fa85785631, 0x552a74227f3ea565},
+    {0x8533285c936b35de, 0xd53a88958f87275f}, {0xa67ff273b8460356, 0x8a892abaf368f137},
+    {0xd01fef10a657842c, 0x2d2b7569b0432d85}, {0x8213f56a67f6b29b, 0x9c3b29620e29fc73},
+    {0xa298f2c501f45f42, 0x8349f3ba91b47b8f}, {0xcb3f2f7642717713, 0x241c70a936219a73},
+    {0xfe0efb53d30dd4d7, 0xed238cd383aa0110}, {0x9ec95d1463e8a506, 0xf4363804324a40aa},
+    {0xc67bb4597ce2ce48, 0xb143c6053edcd0d5}, {0xf81aa16fdc1b81da, 0xdd94b7868e94050a},
+    {0x9b10a4e5e9913128, 0xca7cf2b4191c8326}, {0xc1d4ce1f63f57d72, 0xfd1c2f611f63a3f0},
+    {0xf24a01a73cf2dccf, 0xbc633b39673c8cec}, {0x976e41088617ca01, 0xd5be0503e085d813},
+    {0xbd49d14aa79dbc82, 0x4b2d8644d8a74e18}, {0xec9c459d51852ba2, 0xddf8e7d60ed1219e},
+    {0x93e1ab8252f33b45, 0xcabb90e5c942b503}, {0xb8da1662e7b00a17, 0x3d6a751f3b936243},
+    {0xe7109bfba19c0c9d, 0x0cc512670a783ad4}, {0x906a617d450187e2, 0x27fb2b80668b24c5},
+    {0xb484f9dc9641e9da, 0xb1f9f660802dedf6}, {0xe1a63853bbd26451, 0x5e7873f8a0396973},
+    {0x8d07e33455637eb2, 0xdb0b487b6423e1e8}, {0xb049dc016abc5e5f, 0x91ce1a9a3d2cda62},
+    {0xdc5c5301c56b75f7, 0x7641a140cc7810fb}, {0x89b9b3e11b6329ba, 0xa9e904c87fcb0a9d},
+    {0xac2820d9623bf429, 0x546345fa9fbdcd44}, {0xd732290fbacaf133, 0xa97c177947ad4095},
+    {0x867f59a9d4bed6c0, 0x49ed8eabcccc485d}, {0xa81f301449ee8c70, 0x5c68f256bfff5a74},
+    {0xd226fc195c6a2f8c, 0x73832eec6fff3111}, {0x83585d8fd9c25db7, 0xc831fd53c5ff7eab},
+    {0xa42e74f3d032f525, 0xba3e7ca8b77f5e55}, {0xcd3a1230c43fb26f, 0x28ce1bd2e55f35eb},
+    {0x80444b5e7aa7cf85, 0x7980d163cf5b81b3}, {0xa0555e361951c366, 0xd7e105bcc332621f},
+    {0xc86ab5c39fa63440, 0x8dd9472bf3fefaa7}, {0xfa856334878fc150, 0xb14f98f6f0feb951},
+    {0x9c935e00d4b9d8d2, 0x6ed1bf9a569f33d3}, {0xc3b8358109e84f07, 0x0a862f80ec4700c8},
+    {0xf4a642e14c6262c8, 0xcd27bb612758c0fa}, {0x98e7e9cccfbd7dbd, 0x8038d51cb897789c},
+    {0xbf21e44003acdd2c, 0xe0470a63e6bd56c3}, {0xeeea5d5004981478, 0x1858ccfce06cac74},
+    {0x95527a5202df0ccb, 0x0f37801e0c43ebc8}, {0xbaa718e68396cffd, 0xd30560258f54e6ba},
+    {0xe950df20247c83fd, 0x47c6b82ef32a2069}, {0x91d28b7416cdd27e, 0x4cdc331d57fa5441},
+    {0xb6472e511c81471d, 0xe0133fe4adf8e952}, {0xe3d8f9e563a198e5, 0x58180fddd97723a6},
+    {0x8e679c2f5e44ff8f, 0x570f09eaa7ea7648}
+};
+
+static inline int clz64(uint64_t x) {
+#if defined(_MSC_VER)
+    uint32_t high = (uint32_t)(x >> 32);
+    unsigned long index;
+    if(high) {
+        _BitScanReverse(&index, high);
+        return 31 - (int)index;
+    }
+    _BitScanReverse(&index, (uint32_t)x);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+// Full 64x64 -> 128 bit product of [a] and [b]. Returns the low half and stores the high one.
+static inline uint64_t mul_128(uint64_t a, uint64_t b, uint64_t *high) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128_t;
+    uint128_t product = (uint128_t)a * b;
+    *high = (uint64_t)(product >> 64);
+    return (uint64_t)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, high);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    *high = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+    return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+// Eisel-Lemire: rounds mantissa * 10^exp10 to the nearest double using only integer arithmetic,
+// by multiplying the normalised mantissa with a 128-bit approximation of the power of ten. For
+// a mantissa that fits in 64 bits the product is always precise enough (Mushtak & Lemire, "Fast
+// number parsing without fallback"), so this never fails. Returns the bits of the (positive)
+// double, which overflows to infinity and underflows to zero like strtod.
+static uint64_t eisel_lemire(uint64_t mantissa, int64_t exp10) {
+    if(mantissa == 0 || exp10 < POW5_MIN) return 0;
+    if(exp10 > POW5_MAX) return UINT64_C(0x7FF) << 52;
+    
+    int shift_in = clz64(mantissa);
+    mantissa <<= shift_in;
+    
+    // We need 55 good bits: the 53 of the result, one to round with, and one that the product
+    // may not have set. If the bits below those are all ones, a carry from the low half of the
+    // power could still reach them.
+    const uint64_t *pow5 = pow5_128[exp10 - POW5_MIN];
+    const uint64_t precision_mask = UINT64_MAX >> 55;
+    uint64_t high;
+    uint64_t low = mul_128(mantissa, pow5[0], &high);
+    if((high & precision_mask) == precision_mask) {
+        uint64_t second_high;
+        mul_128(mantissa, pow5[1], &second_high);
+        low += second_high;
+        high += second_high > low;
+    }
+    
+    int upper = (int)(high >> 63);
+    int shift = upper + 64 - 55;
+    uint64_t bits = high >> shift;
+    // floor(log2(10^exp10)) + 63, then biased.
+    int64_t exp2 = (((152170 + 65536) * exp10) >> 16) + 63 + upper - shift_in + 1023;
+    
+    if(exp2 <= 0) {
+        // Subnormal, or zero once the bits below the smallest exponent are dropped.
+        if(-exp2 + 1 >= 64) return 0;
+        bits >>= -exp2 + 1;
+        bits += bits & 1;
+        bits >>= 1;
+        // Rounding up may give 1 << 52, which is already the encoding of the smallest normal.
+        return bits;
+    }
+    
+    // Half-way between two doubles, which rounds to even. This can only happen when nothing but
+    // zeros were dropped from an exact product, and products are only exact for small powers.
+    if(low <= 1 && exp10 >= -4 && exp10 <= 23 && (bits & 3) == 1 && (bits << shift) == high) {
+        bits &= ~UINT64_C(1);
+    }
+    
+    bits += bits & 1;
+    bits >>= 1;
+    if(bits >= (UINT64_C(2) << 52)) {
+        bits = UINT64_C(1) << 52;
+        exp2 += 1;
+    }
+    if(exp2 >= 0x7FF) return UINT64_C(0x7FF) << 52;
+    return (bits & ~(UINT64_C(1) << 52)) | ((uint64_t)exp2 << 52);
+}
+
+#if PARSE_HAS_USELOCALE
+static locale_t c_locale;
+
+static void make_c_locale(void) {
+    c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+#endif
+
+// strtod in the C locale, so the host program's setlocale() can't change what '.' means. The C
+// locale is made once and only switched to on the calling thread, which leaves the others alone.
+static double c_strtod(const char *str) {
+#if PARSE_HAS_USELOCALE
+#if PARSE_HAS_THREADS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, make_c_locale);
+#else
+    if(!c_locale) make_c_locale();
+#endif
+    if(c_locale) {
+        locale_t previous = uselocale(c_locale);
+        double value = strtod(str, NULL);
+        uselocale(previous);
+        return value;
+    }
+    return strtod(str, NULL);
+#elif defined(_MSC_VER)
+    // There's no once-only initialisation without <windows.h>, and this path is rare enough to
+    // make the locale each time.
+    _locale_t locale = _create_locale(LC_NUMERIC, "C");
+    if(!locale) return strtod(str, NULL);
+    double value = _strtod_l(str, NULL, locale);
+    _free_locale(locale);
+    return value;
+#else
+    return strtod(str, NULL);
+#endif
+}
+
+// Slow path for the hard cases: strtod on a NUL-terminated copy of the token.
+static double slow_float(const char *start, size_t len) {
+    char small[64];
+    char *buf = len < sizeof(small) ? small : PARSE_CALLOC(len+1, sizeof(char));
+    PARSE_ASSERT(buf);
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    
+    double value = c_strtod(buf);
+    if(buf != small) PARSE_FREE(buf);
+    return value;
+}
+
+// Converts a token that the lexer classified as a float. We keep the first 19 significant digits
+// of the mantissa, which fit in a uint64_t. Clinger's path handles the easy cases, Eisel-Lemire
+// the rest, and strtod is only left with the rare long mantissas that Eisel-Lemire can't settle.
+static double convert_float(const char *start, size_t len) {
+    const char *ptr = start;
+    const char *end = start + len;
+    
+    bool negative = false;
+    if(is_class(*ptr, CC_SIGN)) negative = *ptr++ == '-';
+    
+    uint64_t mantissa = 0;
+    int64_t exp10 = 0;
+    int digits = 0;
+    bool truncated = false;
+    bool fraction = false;
+    
+    for(; ptr != end && !is_class(*ptr, CC_EXP); ++ptr) {
+        if(is_class(*ptr, CC_DOT)) {
+            fraction = true;
+            continue;
+        }
+        int digit = *ptr - '0';
+        if(digits < 19) {
+            mantissa = mantissa * 10 + digit;
+            digits += mantissa != 0;
+            exp10 -= fraction;
+        } else {
+            truncated |= digit != 0;
+            exp10 += !fraction;
+        }
+    }
+    
+    if(ptr != end) {
+        ptr += 1;
+        bool exp_negative = false;
+        if(is_class(*ptr, CC_SIGN)) exp_negative = *ptr++ == '-';
+        
+        int64_t exp = 0;
+        for(; ptr != end; ++ptr) {
+            if(exp < 100000) exp = exp * 10 + (*ptr - '0');
+        }
+        exp10 += exp_negative ? -exp : exp;
+    }
+    
+    double value;
+    if(!truncated && fast_float(mantissa, exp10, &value)) return negative ? -value : value;
+    
+    // With more than 19 digits, the value is somewhere between the truncated mantissa and the
+    // next one up. If both round to the same double, so does the value.
+    uint64_t bits = eisel_lemire(mantissa, exp10);
+    if(truncated && eisel_lemire(mantissa + 1, exp10) != bits) return slow_float(start, len);
+    memcpy(&value, &bits, sizeof(value));
+    return negative ? -value : value;
+}
+
+// Tokens are words made of letters, digits, signs and dots. Numbers are recognised as
+//
+//   int    = sign? digit+
+//   float  = sign? (digit+ '.' digit* | '.' digit+) exp?
+//          | sign? digit+ exp
+//   exp    = ('e' | 'E') sign? digit+
+//
+// and anything else is text. This is the reference lexer: it steps a state machine one byte at
+// a time, and copes with the end of the buffer and with stream refills. Numbers are converted
+// later, and only if their value is asked for.
+static tok_kind_t scan_token(parser_t *parser) {
+    enum {
+        STATE_START,
+        STATE_SIGN,
+        STATE_INT,
+        STATE_DOT,
+        STATE_FRAC,
+        STATE_EXP_MARK,
+        STATE_EXP_SIGN,
+        STATE_EXP,
+        STATE_TEXT,
+    };
+    
+    int state = STATE_START;
+    size_t len = 0;
+    while(is_tok_char(peek(parser))) {
+        int c = advance(parser);
+        len += 1;
+        switch(state) {
+        case STATE_START:
+            if(is_class(c, CC_SIGN)) state = STATE_SIGN;
+            else if(is_class(c, CC_DIGIT)) state = STATE_INT;
+            else if(is_class(c, CC_DOT)) state = STATE_DOT;
+            else state = STATE_TEXT;
+            break;
+            
+        case STATE_SIGN:
+            if(is_class(c, CC_DIGIT)) state = STATE_INT;
+            else if(is_class(c, CC_DOT)) state = STATE_DOT;
+            else state = STATE_TEXT;
+            break;
+            
+        case STATE_INT:
+            if(is_class(c, CC_DOT)) state = STATE_FRAC;
+            else if(is_class(c, CC_EXP)) state = STATE_EXP_MARK;
+            else if(!is_class(c, CC_DIGIT)) state = STATE_TEXT;
+            break;
+            
+        case STATE_DOT:
+            if(is_class(c, CC_DIGIT)) state = STATE_FRAC;
+            else state = STATE_TEXT;
+            break;
+            
+        case STATE_FRAC:
+            if(is_class(c, CC_EXP)) state = STATE_EXP_MARK;
+            else if(!is_class(c, CC_DIGIT)) state = STATE_TEXT;
+            break;
+            
+        case STATE_EXP_MARK:
+            if(is_class(c, CC_SIGN)) state = STATE_EXP_SIGN;
+            else if(is_class(c, CC_DIGIT)) state = STATE_EXP;
+            else state = STATE_TEXT;
+            break;
+            
+        case STATE_EXP_SIGN:
+        case STATE_EXP:
+            if(is_class(c, CC_DIGIT)) state = STATE_EXP;
+            else state = STATE_TEXT;
+            break;
+            
+        case STATE_TEXT:
+            break;
+            
+            default: break;
+        }
+    }
+    
+    parser->tok.len = len;
+    switch(state) {
+    case STATE_INT: return TOK_INT;
+    case STATE_FRAC:
+    case STATE_EXP: return TOK_FLOAT;
+    default: return TOK_TEXT;
+    }
+}
+
+#if defined(PARSE_SIMD)
+// One bit per byte for the 64 bytes at ptr.
+typedef struct {
+    uint64_t    tok;
+    uint64_t    digit;
+    uint64_t    dot;
+    uint64_t    exp;
+    uint64_t    sign;
+} tok_masks_t;
+
+static void classify_bytes(const char *ptr, tok_masks_t *masks) {
+    const vec_t zero = vec_set('0');
+    const vec_t nine = vec_set(9);
+    const vec_t a = vec_set('a');
+    const vec_t z = vec_set('z' - 'a');
+    const vec_t lower = vec_set(0x20);
+    const vec_t dot = vec_set('.');
+    const vec_t plus = vec_set('+');
+    const vec_t minus = vec_set('-');
+    const vec_t e = vec_set('e');
+    
+    memset(masks, 0, sizeof(*masks));
+    for(int i = 0; i < 64; i += PARSE_SIMD) {
+        vec_t v = vec_load(ptr + i);
+        vec_t d = vec_sub(v, zero);
+        vec_t l = vec_or(v, lower);
+        vec_t al = vec_sub(l, a);
+        
+        vec_t is_digit = vec_eq(vec_min(d, nine), d);
+        vec_t is_alpha = vec_eq(vec_min(al, z), al);
+        vec_t is_dot = vec_eq(v, dot);
+        vec_t is_sign = vec_or(vec_eq(v, plus), vec_eq(v, minus));
+        vec_t is_tok = vec_or(vec_or(is_digit, is_alpha), vec_or(is_dot, is_sign));
+        
+        masks->tok |= (uint64_t)vec_mask(is_tok) << i;
+        masks->digit |= (uint64_t)vec_mask(is_digit) << i;
+        masks->dot |= (uint64_t)vec_mask(is_dot) << i;
+        masks->exp |= (uint64_t)vec_mask(vec_eq(l, e)) << i;
+        masks->sign |= (uint64_t)vec_mask(is_sign) << i;
+    }
+}
+
+// Length of the run of digits starting at bit [i]. Bits past the token are clear in [digit].
+static inline int digit_run(uint64_t digit, int i) {
+    return ctz64(~(digit >> i));
+}
+
+// Finds the end of the token at the cursor 64 bytes at a time, and classifies it with the same
+// grammar as scan_token from the byte class masks. Only used when 64 bytes can be loaded, which
+// padded buffers always allow; returns false, without moving, for tokens that don't fit in them.
+static bool scan_token_fast(parser_t *parser, tok_kind_t *kind) {
+    if(!parser->padded && parser->end - parser->ptr < 64) return false;
+    
+    tok_masks_t m;
+    classify_bytes(parser->ptr, &m);
+    if(!~m.tok) return false;
+    
+    int len = ctz64(~m.tok);
+    // A token that runs into the end of a stream window may carry on after the next refill.
+    if(parser->refill && parser->ptr + len == parser->end) return false;
+    uint64_t span = (UINT64_C(1) << len) - 1;
+    uint64_t digit = m.digit & span;
+    
+    int i = (m.sign & 1) ? 1 : 0;
+    int mantissa = digit_run(digit, i);
+    i += mantissa;
+    
+    *kind = TOK_INT;
+    if(i < len && ((m.dot >> i) & 1)) {
+        int frac = digit_run(digit, i + 1);
+        mantissa += frac;
+        i += 1 + frac;
+        *kind = TOK_FLOAT;
+    }
+    if(!mantissa) {
+        *kind = TOK_TEXT;
+    } else if(i < len && ((m.exp >> i) & 1)) {
+        i += 1;
+        if(i < len && ((m.sign >> i) & 1)) i += 1;
+        int exp = digit_run(digit, i);
+        i += exp;
+        *kind = exp ? TOK_FLOAT : TOK_TEXT;
+    }
+    if(i != len) *kind = TOK_TEXT;
+    
+    parser->tok.len = len;
+    parser->ptr += len;
+    if(!parser->lazy_pos) parser->column += len;
+    return true;
+}
+#endif
+
+static const tok_t *make_token(parser_t *parser) {
+    tok_kind_t kind;
+#if defined(PARSE_SIMD)
+    if(!scan_token_fast(parser, &kind))
+#endif
+    kind = scan_token(parser);
+    parser->tok.kind = kind;
+    parser->tok.has_value = false;
+    return &parser->tok;
+}
+
+static const tok_t *scan_next(parser_t *parser) {
+    skip_whitespace(parser);
+    parser->tok.start = parser->ptr;
+    parser->tok.line = parser->lazy_pos ? -1 : parser->line;
+    parser->tok.column = parser->lazy_pos ? -1 : parser->column;
+    
+    int c = peek(parser);
+    
+    if(c == EOF) {
+        parser->tok.kind = TOK_EOF;
+        parser->tok.len = 0;
+        return &parser->tok;
+    }
+    
+    if(is_tok_char(c)) {
+        return make_token(parser);
+    }
+    
+    parser->tok.kind = TOK_INVALID;
+    parser->tok.len = 0;
+    return &parser->tok;
+}
+
+static void load_token(parser_t *parser, size_t index);
+static void pop_ahead(parser_t *parser);
+
+const tok_t *lex(parser_t *parser) {
+    if(parser->error) return &parser->tok;
+    if(parser->tok_next) {
+        if(parser->tok_next < parser->tok_count) load_token(parser, parser->tok_next);
+        return &parser->tok;
+    }
+    if(parser->ahead_count) {
+        pop_ahead(parser);
+        return &parser->tok;
+    }
+    return scan_next(parser);
+}
+
+// Token arrays. The tokens are scanned once into an array, with their numeric values converted
+// when they fit; after that, lex() just copies the next entry into parser->tok. tok_next is only
+// set once the array is complete, which is what switches lex() over.
+
+_Static_assert(sizeof(parse_token_t) == 16, "parse_token_t should fit in 16 bytes");
+
+static inline void unpack_token(const parser_t *parser, const parse_token_t *token, tok_t *tok) {
+    tok->kind = (tok_kind_t)token->kind;
+    tok->start = parser->src + token->offset;
+    tok->len = token->len;
+    tok->line = -1;
+    tok->column = -1;
+    tok->has_value = token->has_value;
+    tok->i64 = token->i64;
+}
+
+static void load_token(parser_t *parser, size_t index) {
+    unpack_token(parser, &parser->toks[index], &parser->tok);
+    parser->ptr = parser->tok.start + parser->tok.len;
+    parser->tok_next = index + 1;
+}
+
+// Packs the current token into [token], numeric value left out. Fails if it doesn't fit.
+static bool pack_token(parser_t *parser, parse_token_t *token) {
+    const tok_t *tok = &parser->tok;
+    if((size_t)(tok->start - parser->src) > PARSE_TOKEN_MAX_OFFSET) {
+        parse_fail(parser, "input too large for compact tokens");
+        return false;
+    }
+    if(tok->len > PARSE_TOKEN_MAX_LEN) {
+        parse_fail(parser, "token too long for compact tokens");
+        return false;
+    }
+    token->offset = (uint32_t)(tok->start - parser->src);
+    token->len = (uint32_t)tok->len;
+    token->kind = tok->kind;
+    token->has_value = false;
+    return true;
+}
+
+static bool push_token(parser_t *parser) {
+    if(parser->tok_count == parser->tok_cap) {
+        size_t cap = parser->tok_cap ? 2 * parser->tok_cap : 1024;
+        parse_token_t *grown = alloc_in(parser, cap, sizeof(parse_token_t));
+        PARSE_ASSERT(grown);
+        if(parser->toks) {
+            memcpy(grown, parser->toks, parser->tok_count * sizeof(parse_token_t));
+            free_in(parser, parser->toks);
+        }
+        parser->toks = grown;
+        parser->tok_cap = cap;
+    }
+    
+    const tok_t *tok = &parser->tok;
+    parse_token_t *token = &parser->toks[parser->tok_count];
+    if(!pack_token(parser, token)) return false;
+    if(tok->kind == TOK_INT) {
+        token->has_value = int_value(tok->start, tok->len, &token->i64);
+    } else if(tok->kind == TOK_FLOAT) {
+        token->f64 = convert_float(tok->start, tok->len);
+        token->has_value = true;
+    }
+    parser->tok_count += 1;
+    return true;
+}
+
+// Appends tokens from the current one to the end of the input or the first invalid token.
+static bool push_tokens(parser_t *parser) {
+    // Positions come from parse_locate in this mode, so there's no point counting lines.
+    bool lazy = parser->lazy_pos;
+    parser->lazy_pos = true;
+    bool ok;
+    while((ok = push_token(parser))) {
+        if(have(parser, TOK_EOF) || have(parser, TOK_INVALID)) break;
+        lex(parser);
+    }
+    parser->lazy_pos = lazy;
+    return ok;
+}
+
+size_t parse_tokenize(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(!parser->refill);
+    if(parser->error) return 0;
+    if(parser->tok_next) return parser->tok_count;
+    // A rewind to before the last parse_tokenize leaves its tokens behind: start over.
+    parser->tok_count = 0;
+    if(!push_tokens(parser)) return 0;
+    
+    load_token(parser, 0);
+    return parser->tok_count;
+}
+
+size_t parse_tok_index(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL && parser->tok_next);
+    return parser->tok_next - 1;
+}
+
+void parse_seek_tok(parser_t *parser, size_t index) {
+    PARSE_ASSERT(parser != NULL && parser->tok_next);
+    PARSE_ASSERT(index < parser->tok_count);
+    load_token(parser, index);
+}
+
+// Lookahead. Tokens scanned past the current one wait in a ring, in compact form, until lex()
+// pops them. Their positions are kept next to them, as they were when the token was scanned.
+
+static void pop_ahead(parser_t *parser) {
+    unpack_token(parser, &parser->ahead[parser->ahead_head], &parser->tok);
+    parser->tok.line = parser->ahead_line[parser->ahead_head];
+    parser->tok.column = parser->ahead_column[parser->ahead_head];
+    parser->ahead_head = (parser->ahead_head + 1) % PARSE_LOOKAHEAD;
+    parser->ahead_count -= 1;
+}
+
+tok_t peek_tok(parser_t *parser, size_t k) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(k <= PARSE_LOOKAHEAD);
+    if(k == 0) return parser->tok;
+    
+    tok_t tok;
+    if(parser->tok_next) {
+        size_t index = parser->tok_next - 1 + k;
+        if(index >= parser->tok_count) index = parser->tok_count - 1;
+        unpack_token(parser, &parser->toks[index], &tok);
+        return tok;
+    }
+    
+    // Tokens can't be held back in a stream: the next refill could move them.
+    PARSE_ASSERT(!parser->refill);
+    tok = parser->tok;
+    while(parser->ahead_count < k && !parser->error) {
+        size_t tail = parser->ahead_head + parser->ahead_count;
+        tok_kind_t last = parser->ahead_count
+            ? (tok_kind_t)parser->ahead[(tail - 1) % PARSE_LOOKAHEAD].kind
+            : tok.kind;
+        if(last == TOK_EOF || last == TOK_INVALID) break;
+        
+        scan_next(parser);
+        size_t slot = tail % PARSE_LOOKAHEAD;
+        if(!pack_token(parser, &parser->ahead[slot])) continue;
+        parser->ahead_line[slot] = parser->tok.line;
+        parser->ahead_column[slot] = parser->tok.column;
+        parser->ahead_count += 1;
+    }
+    parser->tok = tok;
+    if(!parser->ahead_count) return tok;
+    
+    size_t last = (k < parser->ahead_count ? k : parser->ahead_count) - 1;
+    size_t slot = (parser->ahead_head + last) % PARSE_LOOKAHEAD;
+    unpack_token(parser, &parser->ahead[slot], &tok);
+    tok.line = parser->ahead_line[slot];
+    tok.column = parser->ahead_column[slot];
+    return tok;
+}
+
+// Backtracking. A mark is where the cursor was after the current token, so rewinding drops any
+// lookahead: those tokens are scanned again if needed.
+
+parse_mark_t parse_mark(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(!parser->refill);
+    
+    parse_mark_t mark;
+    mark.tok = parser->tok;
+    mark.tok_next = parser->tok_next;
+    mark.had_error = parser->error != NULL;
+    mark.error_count = parser->error_count;
+    if(parser->ahead_count) {
+        // Peeking stops at EOF and invalid tokens, so the current token has a length.
+        mark.ptr = parser->tok.start + parser->tok.len;
+        mark.line = parser->tok.line;
+        mark.column = parser->tok.column + (int)parser->tok.len;
+    } else {
+        mark.ptr = parser->ptr;
+        mark.line = parser->line;
+        mark.column = parser->column;
+    }
+    return mark;
+}
+
+void parse_rewind(parser_t *parser, const parse_mark_t *mark) {
+    PARSE_ASSERT(parser != NULL && mark != NULL);
+    PARSE_ASSERT(mark->ptr >= parser->src && mark->ptr <= parser->end);
+    
+    if(parser->error && !mark->had_error) {
+        parser->error = NULL;
+        parser->err.code = PARSE_OK;
+    }
+    parser->error_count = mark->error_count;
+    parser->tok = mark->tok;
+    parser->tok_next = mark->tok_next;
+    parser->ptr = mark->ptr;
+    parser->line = mark->line;
+    parser->column = mark->column;
+    parser->ahead_head = 0;
+    parser->ahead_count = 0;
+}
+
+tok_t parse_token_at(parser_t *parser, const parse_token_t *token) {
+    PARSE_ASSERT(parser != NULL && token != NULL);
+    tok_t tok;
+    unpack_token(parser, token, &tok);
+    parse_locate(parser, tok.start, &tok.line, &tok.column);
+    return tok;
+}
+
+int64_t tok_int(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->tok.kind != TOK_INT) return 0;
+    if(!parser->tok.has_value) {
+        parser->tok.i64 = convert_int(parser);
+        parser->tok.has_value = true;
+    }
+    return parser->tok.i64;
+}
+
+double tok_float(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    // Integers are read with the float conversion, so ones too large for an int64_t still work.
+    // The result isn't cached, the token's value slot belongs to tok_int.
+    if(parser->tok.kind == TOK_INT) return convert_float(parser->tok.start, parser->tok.len);
+    if(parser->tok.kind != TOK_FLOAT) return NAN;
+    if(!parser->tok.has_value) {
+        parser->tok.f64 = convert_float(parser->tok.start, parser->tok.len);
+        parser->tok.has_value = true;
+    }
+    return parser->tok.f64;
+}
+
+bool have(parser_t *parser, tok_kind_t kind) {
+    PARSE_ASSERT(parser != NULL);
+    return parser->tok.kind == kind;
+}
+
+bool match(parser_t *parser, tok_kind_t kind) {
+    PARSE_ASSERT(parser != NULL);
+    if(!have(parser, kind)) return false;
+    (void)lex(parser);
+    return true;
+}
+
+static const char *tok_name(tok_kind_t kind) {
+    switch(kind) {
+        case TOK_INVALID: return "an invalid token";
+        case TOK_EOF: return "the end of file";
+        case TOK_INT: return "an integer";
+        case TOK_FLOAT: return "a number";
+        case TOK_TEXT: return "a word";
+    }
+    return "<bad token kind>";
+}
+
+void syntax_error(parser_t *parser, tok_kind_t kind) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return;
+    set_error(parser, PARSE_ERR_SYNTAX, kind, "syntax error");
+}
+
+size_t parse_format_error(parser_t *parser, const parse_error_t *err, char *out, size_t cap) {
+    PARSE_ASSERT(parser != NULL && err != NULL);
+    PARSE_ASSERT(out != NULL || cap == 0);
+    
+    int len = 0;
+    switch(err->code) {
+    case PARSE_OK:
+        len = snprintf(out, cap, "no error");
+        break;
+    case PARSE_ERR_SYNTAX:
+        len = snprintf(out, cap, "found %s, but needed %s",
+            tok_name(err->found), tok_name(err->expected));
+        break;
+    case PARSE_ERR_RANGE:
+        len = snprintf(out, cap, "integer out of range: %.*s",
+            (int)err->len, parser->src + err->offset);
+        break;
+    case PARSE_ERR_FAIL:
+        // Only the latest message is kept.
+        len = snprintf(out, cap, "%s", err == &parser->err ? parser->message : "parse failure");
+        break;
+    }
+    return len > 0 ? (size_t)len : 0;
+}
+
+const char *parse_error_message(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(!parser->error) return NULL;
+    if(parser->err.code != PARSE_ERR_FAIL) {
+        parse_format_error(parser, &parser->err, parser->message, sizeof(parser->message));
+    }
+    return parser->message;
+}
+
+// Recovery. After an error, parse_sync drops the rest of the line the error happened on, unless
+// the faulty token starts a line of its own and isn't where the record started: then, the record
+// was just too short, and the token most likely starts the next one.
+
+void parse_recover(parser_t *parser, parse_error_t *errors, size_t cap) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(errors != NULL || cap == 0);
+    parser->errors = errors;
+    parser->error_cap = cap;
+    parser->error_count = 0;
+    parser->sync_start = parser->tok.start;
+}
+
+static bool starts_line(parser_t *parser, const char *at) {
+    while(at != parser->src && is_class(at[-1], CC_SPACE)) at -= 1;
+    return at == parser->src ? parser->src_line_start : at[-1] == '\n';
+}
+
+// Moves the cursor past the next line break, or to the end of the input.
+static void skip_line(parser_t *parser) {
+    for(;;) {
+        const char *nl = memchr(parser->ptr, '\n', parser->end - parser->ptr);
+        if(nl) {
+            skip_to(parser, nl + 1);
+            return;
+        }
+        skip_to(parser, parser->end);
+        parser->tok.start = parser->ptr;
+        if(peek(parser) == EOF) return;
+    }
+}
+
+static void next_line(parser_t *parser) {
+    const char *tok_end = parser->tok.start + parser->tok.len;
+    
+    if(parser->tok_next) {
+        const char *nl = memchr(tok_end, '\n', parser->end - tok_end);
+        size_t resume = nl ? (size_t)(nl + 1 - parser->src) : (size_t)(parser->end - parser->src);
+        size_t index = parser->tok_next - 1;
+        while(index + 1 < parser->tok_count && parser->toks[index].offset < resume) index += 1;
+        
+        // The array stops at the first invalid token: past it, tokenize again from the next line.
+        if(parser->toks[index].offset < resume && parser->toks[index].kind == TOK_INVALID) {
+            parser->tok_count = index;
+            parser->tok_next = 0;
+            parser->ptr = parser->src + resume;
+            lex(parser);
+            if(!push_tokens(parser)) return;
+        }
+        load_token(parser, index);
+        return;
+    }
+    
+    if(parser->ahead_count) {
+        parser->ahead_head = 0;
+        parser->ahead_count = 0;
+        parser->ptr = tok_end;
+        if(!parser->lazy_pos) parse_locate(parser, tok_end, &parser->line, &parser->column);
+    }
+    skip_line(parser);
+    scan_next(parser);
+}
+
+bool parse_sync(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    bool failed = parser->error != NULL;
+    if(failed) {
+        const char *at = parser->tok.start;
+        bool keep = at != parser->sync_start && starts_line(parser, at);
+        parser->error = NULL;
+        parser->err.code = PARSE_OK;
+        if(!keep && !have(parser, TOK_EOF)) next_line(parser);
+    }
+    parser->sync_start = parser->tok.start;
+    return failed;
+}
+
+void expect(parser_t *parser, tok_kind_t kind) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return;
+    if(!have(parser, kind)) {
+        syntax_error(parser, kind);
+        return;
+    }
+    lex(parser);
+}
+
+int64_t parse_int(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return 0;
+    if(!have(parser, TOK_INT)) {
+        syntax_error(parser, TOK_INT);
+        return 0;
+    }
+    int64_t val = tok_int(parser);
+    lex(parser);
+    return val;
+}
+
+double parse_float(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return 0;
     if(!have(parser, TOK_INT) && !have(parser, TOK_FLOAT)) {
         syntax_error(parser, TOK_FLOAT);
         return NAN;
     }
-    double val = parser->tok.kind == TOK_FLOAT ? parser->tok.f64 : parser->tok.i64;
+    double val = tok_float(parser);
     lex(parser);
     return val;
 }
@@ -297,14 +2046,591 @@ size_t parse_text(parser_t *parser, char *out, size_t cap) {
         return 0;
     }
     
+    // Copy before lexing: in streaming mode, the next token may overwrite this one.
     size_t len = parser->tok.len;
-    const char *src = parser->tok.start;
+    if(out) {
+        if(cap < len) {
+            len = cap;
+        }
+        memcpy(out, parser->tok.start, len);
+        if(len < cap) out[len] = '\0';
+    }
+    lex(parser);
+    return len;
+}
+
+// Bulk helpers: the same checks as parse_int/parse_float, without the calls through the public
+// helpers. Values already stored in the token (by parse_tokenize, or an earlier tok_int/tok_float)
+// are used as they are; the others are converted straight from the token span, and not cached.
+
+static inline bool take_int(parser_t *parser, int64_t *out, int64_t min, int64_t max) {
+    if(!have(parser, TOK_INT)) {
+        syntax_error(parser, TOK_INT);
+        return false;
+    }
+    int64_t value = parser->tok.has_value ? parser->tok.i64 : convert_int(parser);
+    if(parser->error) return false;
+    if(value < min || value > max) {
+        parse_range_error(parser);
+        return false;
+    }
+    *out = value;
+    lex(parser);
+    return true;
+}
+
+static inline bool take_float(parser_t *parser, double *out) {
+    if(!have(parser, TOK_FLOAT) && !have(parser, TOK_INT)) {
+        syntax_error(parser, TOK_FLOAT);
+        return false;
+    }
+    if(!parser->tok.has_value) {
+        *out = convert_float(parser->tok.start, parser->tok.len);
+    } else if(have(parser, TOK_INT)) {
+        *out = (double)parser->tok.i64;
+    } else {
+        *out = parser->tok.f64;
+    }
+    lex(parser);
+    return true;
+}
+
+size_t parse_int_array(parser_t *parser, int64_t *out, size_t count) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(out != NULL || count == 0);
+    size_t i = 0;
+    while(i < count && !parser->error && take_int(parser, &out[i], INT64_MIN, INT64_MAX)) {
+        i += 1;
+    }
+    return i;
+}
+
+size_t parse_int32_array(parser_t *parser, int32_t *out, size_t count) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(out != NULL || count == 0);
+    size_t i = 0;
+    int64_t value;
+    while(i < count && !parser->error && take_int(parser, &value, INT32_MIN, INT32_MAX)) {
+        out[i++] = (int32_t)value;
+    }
+    return i;
+}
+
+size_t parse_float_array(parser_t *parser, double *out, size_t count) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(out != NULL || count == 0);
+    size_t i = 0;
+    while(i < count && !parser->error && take_float(parser, &out[i])) {
+        i += 1;
+    }
+    return i;
+}
+
+size_t parse_float32_array(parser_t *parser, float *out, size_t count) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(out != NULL || count == 0);
+    size_t i = 0;
+    double value;
+    while(i < count && !parser->error && take_float(parser, &value)) {
+        out[i++] = (float)value;
+    }
+    return i;
+}
+
+void skip_int(parser_t *parser) {
+    expect(parser, TOK_INT);
+}
+
+void skip_float(parser_t *parser) {
+    PARSE_ASSERT(parser != NULL);
+    if(parser->error) return;
+    if(!have(parser, TOK_INT) && !have(parser, TOK_FLOAT)) {
+        syntax_error(parser, TOK_FLOAT);
+        return;
+    }
     lex(parser);
+}
+
+void skip_text(parser_t *parser) {
+    expect(parser, TOK_TEXT);
+}
+
+// Records. Each field goes through the same inline helpers as the bulk array functions, so a
+// record costs one switch per field and no call into the public helpers.
+
+// Size of the value a field stores, or 0 for skipped fields.
+static size_t column_width(const parse_field_t *field) {
+    switch(field->kind) {
+    case FIELD_INT:     return sizeof(int64_t);
+    case FIELD_INT32:   return sizeof(int32_t);
+    case FIELD_FLOAT:   return sizeof(double);
+    case FIELD_FLOAT32: return sizeof(float);
+    case FIELD_TEXT:    return field->size;
+    default:            return 0;
+    }
+}
+
+static bool decode_field(parser_t *parser, const parse_field_t *field, void *at) {
+    // PARSE_FIELD records the member's size, which catches numeric kinds that don't match it.
+    PARSE_ASSERT(!field->size || field->size == column_width(field));
+    double scale = field->scale != 0 ? field->scale : 1;
+    int64_t i;
+    double f;
+
+    switch(field->kind) {
+    case FIELD_INT:
+        return take_int(parser, at, INT64_MIN, INT64_MAX);
+    case FIELD_INT32:
+        if(!take_int(parser, &i, INT32_MIN, INT32_MAX)) return false;
+        *(int32_t *)at = (int32_t)i;
+        return true;
+    case FIELD_FLOAT:
+        if(!take_float(parser, &f)) return false;
+        *(double *)at = f * scale;
+        return true;
+    case FIELD_FLOAT32:
+        if(!take_float(parser, &f)) return false;
+        *(float *)at = (float)(f * scale);
+        return true;
+    case FIELD_TEXT:
+        PARSE_ASSERT(field->size > 0);
+        if(!have(parser, TOK_TEXT)) {
+            syntax_error(parser, TOK_TEXT);
+            return false;
+        } else {
+            size_t len = parser->tok.len < field->size ? parser->tok.len : field->size - 1;
+            memcpy(at, parser->tok.start, len);
+            ((char *)at)[len] = '\0';
+        }
+        lex(parser);
+        return true;
+    case FIELD_SKIP_INT:
+        skip_int(parser);
+        break;
+    case FIELD_SKIP_FLOAT:
+        skip_float(parser);
+        break;
+    case FIELD_SKIP_TEXT:
+        skip_text(parser);
+        break;
+    }
+    return !parser->error;
+}
+
+bool parse_record(parser_t *parser, const parse_field_t *fields, size_t field_count, void *out) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(fields != NULL || field_count == 0);
+    PARSE_ASSERT(out != NULL);
+    if(parser->error) return false;
+
+    for(size_t i = 0; i < field_count; ++i) {
+        if(!decode_field(parser, &fields[i], (char *)out + fields[i].offset)) return false;
+    }
+    return true;
+}
+
+size_t parse_records(parser_t *parser, const parse_field_t *fields, size_t field_count,
+                     void *out, size_t stride, size_t count) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(out != NULL || count == 0);
+    char *base = out;
+    size_t n = 0;
+    while(n < count && parse_record(parser, fields, field_count, base)) {
+        base += stride;
+        n += 1;
+    }
+    return n;
+}
+
+// Columns all have room for [cap] rows, and grow together. Field offsets are ignored: each column
+// is an array of the field's type, and skipped fields have no column.
+
+static void grow_columns(parse_columns_t *columns, const parse_field_t *fields) {
+    size_t cap = columns->cap ? 2 * columns->cap : 256;
+    for(size_t i = 0; i < columns->field_count; ++i) {
+        size_t width = column_width(&fields[i]);
+        if(!width) continue;
+
+        char *grown = PARSE_CALLOC(cap, width);
+        PARSE_ASSERT(grown);
+        if(columns->data[i]) {
+            memcpy(grown, columns->data[i], columns->count * width);
+            PARSE_FREE(columns->data[i]);
+        }
+        columns->data[i] = grown;
+    }
+    columns->cap = cap;
+}
+
+size_t parse_columns(parser_t *parser, const parse_field_t *fields, size_t field_count,
+                     parse_columns_t *columns, size_t max) {
+    PARSE_ASSERT(parser != NULL);
+    PARSE_ASSERT(fields != NULL && field_count > 0);
+    PARSE_ASSERT(columns != NULL);
+
+    if(!columns->data) {
+        columns->data = PARSE_CALLOC(field_count, sizeof(void *));
+        PARSE_ASSERT(columns->data);
+        columns->field_count = field_count;
+    }
+    PARSE_ASSERT(columns->field_count == field_count);
+
+    size_t n = 0;
+    while((!max || n < max) && !parser->error && !have(parser, TOK_EOF)) {
+        if(columns->count == columns->cap) grow_columns(columns, fields);
+
+        size_t row = columns->count;
+        for(size_t i = 0; i < field_count; ++i) {
+            void *at = columns->data[i]
+                ? (char *)columns->data[i] + row * column_width(&fields[i])
+                : NULL;
+            if(!decode_field(parser, &fields[i], at)) return n;
+        }
+        columns->count += 1;
+        n += 1;
+    }
+    return n;
+}
+
+void parse_columns_fini(parse_columns_t *columns) {
+    PARSE_ASSERT(columns != NULL);
+    for(size_t i = 0; i < columns->field_count; ++i) {
+        PARSE_FREE(columns->data[i]);
+    }
+    PARSE_FREE(columns->data);
+    memset(columns, 0, sizeof(*columns));
+}
+
+// Parallel parsing. The buffer is cut into one chunk per thread, at record boundaries. A first
+// pass counts the line breaks in each chunk, so that the second, which parses every record of
+// every chunk, can give each record parser its absolute line number.
+
+typedef struct {
+    const char      *start;
+    const char      *end;
+    const char      *separator;
+    size_t          separator_len;
+    
+    bool            counting;
+    int             line;
+    size_t          records;
     
-    if(!out) return len;
-    if(cap < len) {
-        len = cap;
+    parse_record_t  record;
+    void            *data;
+#if PARSE_HAS_THREADS
+    pthread_t       thread;
+    bool            running;
+#endif
+} chunk_t;
+
+// Whether the line [start, end), without its line break, separates records: a blank line if no
+// separator is given, or a line that is exactly the separator. Separators are only recognised as
+// whole lines, so they can't be matched inside comments or records.
+static bool is_separator(const chunk_t *chunk, const char *start, const char *end) {
+    if(end != start && end[-1] == '\r') end -= 1;
+    if(!chunk->separator) {
+        while(start != end && is_class(*start, CC_SPACE)) start += 1;
+        return start == end;
     }
-    strncpy(out, src, cap);
-    return len;
+    return (size_t)(end - start) == chunk->separator_len
+        && !memcmp(start, chunk->separator, chunk->separator_len);
+}
+
+// Finds the end of the record that starts at [ptr], a line start. Returns the start of the next
+// record, and stores the end of this one (where its separator line starts) in [record_end].
+static const char *next_record(const chunk_t *chunk, const char *ptr, const char **record_end) {
+    while(ptr != chunk->end) {
+        const char *nl = memchr(ptr, '\n', chunk->end - ptr);
+        const char *eol = nl ? nl : chunk->end;
+        const char *next = nl ? nl + 1 : chunk->end;
+        if(is_separator(chunk, ptr, eol)) {
+            *record_end = ptr;
+            return next;
+        }
+        ptr = next;
+    }
+    *record_end = chunk->end;
+    return chunk->end;
+}
+
+static void parse_chunk(chunk_t *chunk) {
+    const char *ptr = chunk->start;
+    int line = chunk->line;
+    
+    while(ptr != chunk->end) {
+        const char *record_end;
+        const char *next = next_record(chunk, ptr, &record_end);
+        
+        if(record_end != ptr) {
+            parser_t parser = {0};
+            init_buffer(&parser, ptr, record_end - ptr, false, line);
+            if(parser.tok.kind != TOK_EOF || parser.error) {
+                chunk->record(&parser, chunk->data);
+                chunk->records += 1;
+            }
+            parse_fini(&parser);
+        }
+        line += (int)count_newlines(ptr, next);
+        ptr = next;
+    }
+}
+
+static void *run_chunk(void *data) {
+    chunk_t *chunk = data;
+    if(chunk->counting) {
+        chunk->line = (int)count_newlines(chunk->start, chunk->end);
+    } else {
+        parse_chunk(chunk);
+    }
+    return NULL;
+}
+
+// Runs every chunk on its own thread, the first one on the calling thread. Chunks we can't
+// start a thread for are run on the calling thread too.
+static void run_chunks(chunk_t *chunks, int count) {
+#if PARSE_HAS_THREADS
+    for(int i = 1; i < count; ++i) {
+        chunks[i].running = pthread_create(&chunks[i].thread, NULL, run_chunk, &chunks[i]) == 0;
+    }
+    run_chunk(&chunks[0]);
+    for(int i = 1; i < count; ++i) {
+        if(chunks[i].running) {
+            pthread_join(chunks[i].thread, NULL);
+        } else {
+            run_chunk(&chunks[i]);
+        }
+    }
+#else
+    for(int i = 0; i < count; ++i) {
+        run_chunk(&chunks[i]);
+    }
+#endif
+}
+
+static int default_threads(void) {
+#if PARSE_HAS_THREADS && defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+size_t parse_parallel(const char *src, size_t len, const char *separator, int threads,
+                      parse_record_t record, void *data) {
+    PARSE_ASSERT(src != NULL);
+    PARSE_ASSERT(record != NULL);
+    
+    // Chunks smaller than this aren't worth a thread.
+    const size_t min_chunk = 64 * 1024;
+    if(threads <= 0) threads = default_threads();
+    if((size_t)threads > len / min_chunk) threads = (int)(len / min_chunk);
+    if(threads < 1) threads = 1;
+    
+    chunk_t *chunks = PARSE_CALLOC(threads, sizeof(chunk_t));
+    PARSE_ASSERT(chunks);
+    
+    const char *end = src + len;
+    const char *start = src;
+    for(int i = 0; i < threads; ++i) {
+        chunk_t *chunk = &chunks[i];
+        chunk->separator = separator;
+        chunk->separator_len = separator ? strlen(separator) : 0;
+        chunk->record = record;
+        chunk->data = data;
+        chunk->counting = true;
+        chunk->start = start;
+        chunk->end = end;
+        
+        // Cut at the first record boundary after an even share of the buffer.
+        if(i + 1 < threads) {
+            const char *cut = src + len / threads * (i + 1);
+            if(cut > start) {
+                const char *nl = memchr(cut - 1, '\n', end - (cut - 1));
+                cut = nl ? nl + 1 : end;
+            } else {
+                cut = start;
+            }
+            const char *record_end;
+            chunk->end = next_record(chunk, cut, &record_end);
+        }
+        start = chunk->end;
+    }
+    
+    run_chunks(chunks, threads);
+    int line = 0;
+    for(int i = 0; i < threads; ++i) {
+        int lines = chunks[i].line;
+        chunks[i].line = line;
+        chunks[i].counting = false;
+        line += lines;
+    }
+    run_chunks(chunks, threads);
+    
+    size_t records = 0;
+    for(int i = 0; i < threads; ++i) {
+        records += chunks[i].records;
+    }
+    PARSE_FREE(chunks);
+    return records;
+}
+
+// Batch parsing. Each worker starts with an even share of the files, as a range of indices, and
+// steals the second half of another worker's range when it runs out. Workers keep their parser
+// from one file to the next and rebind it like parse_reinit_file, so its file buffer only grows to
+// the size of the largest file, and its token array and newline index are allocated once.
+
+typedef struct batch_s batch_t;
+
+typedef struct {
+    batch_t         *batch;
+    int             id;
+#if PARSE_HAS_THREADS
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    bool            running;
+#endif
+    size_t          next;
+    size_t          end;
+    
+    parser_t        parser;
+    size_t          failed;
+} batch_worker_t;
+
+struct batch_s {
+    const char *const   *paths;
+    parse_file_t        file;
+    void                *data;
+    batch_worker_t      *workers;
+    int                 count;
+};
+
+static void lock_worker(batch_worker_t *worker) {
+#if PARSE_HAS_THREADS
+    pthread_mutex_lock(&worker->lock);
+#else
+    (void)worker;
+#endif
+}
+
+static void unlock_worker(batch_worker_t *worker) {
+#if PARSE_HAS_THREADS
+    pthread_mutex_unlock(&worker->lock);
+#else
+    (void)worker;
+#endif
+}
+
+// Takes the next file off [worker]'s range, or steals half of another worker's range.
+static bool next_file(batch_worker_t *worker, size_t *index) {
+    lock_worker(worker);
+    bool found = worker->next < worker->end;
+    if(found) *index = worker->next++;
+    unlock_worker(worker);
+    if(found) return true;
+    
+    batch_t *batch = worker->batch;
+    for(int i = 1; i < batch->count; ++i) {
+        batch_worker_t *victim = &batch->workers[(worker->id + i) % batch->count];
+        lock_worker(victim);
+        size_t left = victim->end - victim->next;
+        size_t from = victim->end - (left + 1) / 2;
+        size_t to = victim->end;
+        victim->end = from;
+        unlock_worker(victim);
+        
+        if(!left) continue;
+        lock_worker(worker);
+        worker->next = from + 1;
+        worker->end = to;
+        unlock_worker(worker);
+        *index = from;
+        return true;
+    }
+    return false;
+}
+
+static void batch_file(batch_worker_t *worker, size_t index) {
+    batch_t *batch = worker->batch;
+    parser_t *parser = &worker->parser;
+    const char *path = batch->paths[index];
+    
+    FILE *f = fopen(path, "rb");
+    if(f) {
+        parse_reinit_file(parser, f);
+        fclose(f);
+    } else {
+        // An empty input, so the parser still holds on to its buffers.
+        int err = errno;
+        unmap_src(parser);
+        init_buffer(parser, "", 0, false, 0);
+        parse_fail(parser, "can't open '%s' (%s)", path, strerror(err));
+    }
+    
+    batch->file(parser, index, batch->data);
+    if(parser->error) worker->failed += 1;
+}
+
+static void *run_batch_worker(void *data) {
+    batch_worker_t *worker = data;
+    size_t index;
+    while(next_file(worker, &index)) {
+        batch_file(worker, index);
+    }
+    return NULL;
+}
+
+size_t parse_batch(const char *const *paths, size_t count, int threads,
+                   parse_file_t file, void *data) {
+    PARSE_ASSERT(paths != NULL || count == 0);
+    PARSE_ASSERT(file != NULL);
+    
+    if(threads <= 0) threads = default_threads();
+    if((size_t)threads > count) threads = (int)count;
+    if(threads < 1) threads = 1;
+#if !PARSE_HAS_THREADS
+    threads = 1;
+#endif
+    
+    batch_t batch = {paths, file, data, NULL, threads};
+    batch.workers = PARSE_CALLOC(threads, sizeof(batch_worker_t));
+    PARSE_ASSERT(batch.workers);
+    
+    for(int i = 0; i < threads; ++i) {
+        batch_worker_t *worker = &batch.workers[i];
+        worker->batch = &batch;
+        worker->id = i;
+        worker->next = count / threads * i;
+        worker->end = i + 1 < threads ? count / threads * (i + 1) : count;
+#if PARSE_HAS_THREADS
+        pthread_mutex_init(&worker->lock, NULL);
+#endif
+    }
+    
+#if PARSE_HAS_THREADS
+    for(int i = 1; i < threads; ++i) {
+        batch_worker_t *worker = &batch.workers[i];
+        worker->running = pthread_create(&worker->thread, NULL, run_batch_worker, worker) == 0;
+    }
+#endif
+    // Workers we couldn't start a thread for have their files stolen by the others.
+    run_batch_worker(&batch.workers[0]);
+    
+#if PARSE_HAS_THREADS
+    for(int i = 1; i < threads; ++i) {
+        if(batch.workers[i].running) pthread_join(batch.workers[i].thread, NULL);
+    }
+#endif
+    
+    size_t failed = 0;
+    for(int i = 0; i < threads; ++i) {
+        batch_worker_t *worker = &batch.workers[i];
+#if PARSE_HAS_THREADS
+        pthread_mutex_destroy(&worker->lock);
+#endif
+        parse_fini(&worker->parser);
+        failed += worker->failed;
+    }
+    PARSE_FREE(batch.workers);
+    return failed;
 }
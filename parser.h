@@ -36,6 +36,25 @@ extern "C" {
 #define PARSE_FREE(x) free(x)
 #endif
 
+// Buffers owned by the parser are followed by this many bytes, the first of which is a NUL
+// sentinel. This lets the lexer stop at the sentinel instead of checking bounds, and vector
+// loads run past the end of the input.
+#define PARSE_PADDING (64)
+
+// Size of the buffer that holds a parser's error message.
+#ifndef PARSE_ERROR_SIZE
+#define PARSE_ERROR_SIZE (128)
+#endif
+
+// How many tokens past the current one peek_tok can see.
+#ifndef PARSE_LOOKAHEAD
+#define PARSE_LOOKAHEAD (4)
+#endif
+
+#ifndef PARSE_STREAM_WINDOW
+#define PARSE_STREAM_WINDOW (64 * 1024)
+#endif
+
 typedef enum {
     TOK_INVALID,
     TOK_TEXT,
@@ -51,33 +70,236 @@ typedef struct {
 
     int         line, column;
 
+    // Numbers are converted lazily: f64/i64 are only valid once has_value is set, which
+    // tok_int/tok_float (and the parse_* helpers that call them) take care of.
+    bool        has_value;
     union {
         double  f64;
         int64_t i64;
     };
 } tok_t;
 
+// Compact, 16-byte form of a token, used in token arrays and for lookahead: it starts [offset]
+// bytes into the source, and its position is worked out from that when needed. Inputs are limited
+// to 4GiB and tokens to 16MiB. parse_token_at rebuilds the full tok_t.
 typedef struct {
+    uint32_t    offset;
+    uint32_t    len : 24;
+    uint32_t    kind : 7;
+    uint32_t    has_value : 1;
+    union {
+        double  f64;
+        int64_t i64;
+    };
+} parse_token_t;
+
+#define PARSE_TOKEN_MAX_OFFSET  (UINT32_MAX)
+#define PARSE_TOKEN_MAX_LEN     ((1u << 24) - 1)
+
+typedef enum {
+    PARSE_OK,
+    PARSE_ERR_SYNTAX,       // A token of the wrong kind
+    PARSE_ERR_RANGE,        // An integer that doesn't fit where it's stored
+    PARSE_ERR_FAIL          // Anything raised with parse_fail
+} parse_error_code_t;
+
+// What went wrong and where: [offset] and [len] locate the token the error happened on in the
+// source (for streams, in the current window).
+typedef struct {
+    parse_error_code_t  code;
+    tok_kind_t          expected, found;
+    size_t              offset, len;
+} parse_error_t;
+
+// Arenas
+// A bump allocator that parsers can take their memory from (see parse_init_arena). Zero-initialise
+// to use blocks of PARSE_ARENA_BLOCK bytes, or set [block_size] first. Memory is given back to the
+// system only by parse_arena_fini: releasing or resetting keeps the blocks for what comes next.
+#ifndef PARSE_ARENA_BLOCK
+#define PARSE_ARENA_BLOCK (1024 * 1024)
+#endif
+
+typedef struct parse_block_s parse_block_t;
+
+typedef struct {
+    parse_block_t   *first, *current;
+    size_t          block_size;
+} parse_arena_t;
+
+typedef struct {
+    parse_block_t   *block;
+    size_t          used;
+} parse_arena_mark_t;
+
+// Supplies more input to a streaming parser: writes at most [cap] bytes to [buf] and returns the
+// number of bytes written. Returning 0 signals the end of the input.
+typedef size_t (*parse_refill_t)(void *data, char *buf, size_t cap);
+
+typedef struct parser_s parser_t;
+
+// Called by parse_parallel for each record, with a parser over just that record.
+typedef void (*parse_record_t)(parser_t *parser, void *data);
+// Called by parse_batch for each file, with a parser over paths[index].
+typedef void (*parse_file_t)(parser_t *parser, size_t index, void *data);
+
+struct parser_s {
     bool        owns_src;
+    bool        mapped_src;
+    bool        padded;
+    // Buffer owned by the parser, which [src] points to when owns_src is set. Kept, like the token
+    // array and the newline index, by parse_reset and parse_reinit_file.
+    char        *buf;
+    size_t      buf_cap;
     const char  *src;
     const char  *end;
     const char  *ptr;
     
     int         line, column;
     tok_t       tok;
+    
+    // Positions of bytes after [pos_base] are recovered from the position of [pos_base] and a
+    // count of line breaks per block, built as far as needed. In lazy mode, that's the only way
+    // to get them: line/column aren't kept up to date while lexing.
+    bool        lazy_pos;
+    const char  *pos_base;
+    int         base_line, base_column;
+    uint32_t    *nl_index;
+    size_t      nl_blocks, nl_cap;
+    
+    // Streaming mode: [src, end) is a window of [window] bytes that refill() slides over the input.
+    parse_refill_t  refill;
+    void            *refill_data;
+    size_t          window;
 
-    char        *error;
-} parser_t;
+    // Token array mode: lex() walks [toks], set up by parse_tokenize, instead of scanning.
+    parse_token_t   *toks;
+    size_t          tok_count, tok_cap, tok_next;
+    
+    // Tokens scanned ahead by peek_tok, that lex() hands out before scanning any further.
+    parse_token_t   ahead[PARSE_LOOKAHEAD];
+    int             ahead_line[PARSE_LOOKAHEAD], ahead_column[PARSE_LOOKAHEAD];
+    size_t          ahead_head, ahead_count;
+
+    // Set when parsing fails, to a short description of [err]. parse_error_message has the
+    // details. Nothing is allocated, so there is nothing to free.
+    const char      *error;
+    parse_error_t   err;
+    char            message[PARSE_ERROR_SIZE];
+    
+    // Recovery mode: errors are also appended to [errors], as long as there is room.
+    parse_error_t   *errors;
+    size_t          error_cap, error_count;
+    const char      *sync_start;
+    bool            src_line_start;     // Only blanks come before [src] on its line.
+    
+    // Where the parser's memory comes from, if not PARSE_CALLOC. [arena_mark] is where it was
+    // when the parser was initialised, which parse_fini releases it back to, and [arena_top] is
+    // the end of the parser's latest allocation.
+    parse_arena_t       *arena;
+    parse_arena_mark_t  arena_mark, arena_top;
+};
+
+// Saved state for parse_rewind.
+typedef struct {
+    const char  *ptr;
+    int         line, column;
+    tok_t       tok;
+    size_t      tok_next;
+    bool        had_error;
+    size_t      error_count;
+} parse_mark_t;
 
 // Bookkeeping
 void parse_init(parser_t *parser, const char *src, size_t len);
+// Like parse_init, for buffers where src[len] is '\0' and is followed by at least PARSE_PADDING-1
+// more readable bytes. Those get the faster, sentinel-based lexer.
+void parse_init_padded(parser_t *parser, const char *src, size_t len);
 void parse_init_file(parser_t *parser, FILE *f);
 void parse_init_path(parser_t *parser, const char *path);
+// Maps the file at [path] instead of reading it into memory. Falls back to parse_init_path's
+// behaviour when the file can't be mapped (pipes, special files, non-POSIX platforms).
+void parse_init_mmap(parser_t *parser, const char *path);
+// Parses input pulled through [refill] in a window of [window] bytes (PARSE_STREAM_WINDOW if 0).
+// Memory use is constant, but tok.start is only valid until the next call to lex(), and no
+// token may be longer than the window.
+void parse_init_stream(parser_t *parser, parse_refill_t refill, void *data, size_t window);
+void parse_init_stream_file(parser_t *parser, FILE *f, size_t window);
 void parse_fini(parser_t *parser);
+// Like parse_init and parse_init_file, for a parser that is already initialised: its buffers are
+// kept and only grown as needed, so parsing many inputs of similar sizes allocates nothing once
+// they are large enough. parse_fini is still needed at the end.
+void parse_reset(parser_t *parser, const char *src, size_t len);
+void parse_reinit_file(parser_t *parser, FILE *f);
+// Initialises a parser with no input, whose buffers (source, token array, position index) all
+// come from [arena] and go back to it with parse_fini. Give it input with parse_reset or
+// parse_reinit_file. An arena serves one live parser at a time, and nothing else may be allocated
+// from it until that parser is finished: growing a buffer or finishing with anything allocated on
+// top of the parser's memory is an assertion failure.
+void parse_init_arena(parser_t *parser, parse_arena_t *arena);
+// Fails with a message formatted into parser->message, truncated to PARSE_ERROR_SIZE.
 void parse_fail(parser_t *parser, const char *fmt, ...);
+// Fails with the same out of range error as the integer helpers, for values checked by the caller.
+void parse_range_error(parser_t *parser);
+// The full error message, formatted when asked for, or NULL if there was no error. Valid until
+// the parser is reinitialised.
+const char *parse_error_message(parser_t *parser);
+// Writes the message for [err], an error from this parser, to [out] like snprintf. Only the
+// latest parse_fail message is kept: older ones are written as a generic failure.
+size_t parse_format_error(parser_t *parser, const parse_error_t *err, char *out, size_t cap);
+
+// Recovery
+// parse_recover turns on recovery mode: every error is also appended to [errors], until [cap] of
+// them have been stored (error_count keeps counting past that). Errors still stop the primitives
+// until parse_sync, which should be called after each record: if there was an error, it clears
+// it and skips to the next line, and returns true.
+void parse_recover(parser_t *parser, parse_error_t *errors, size_t cap);
+bool parse_sync(parser_t *parser);
+
+// Arena allocation. Memory is zeroed and 16-byte aligned, and valid until the arena is released
+// to a mark taken before it, reset, or finalised.
+void *parse_arena_alloc(parse_arena_t *arena, size_t size);
+parse_arena_mark_t parse_arena_mark(parse_arena_t *arena);
+void parse_arena_release(parse_arena_t *arena, parse_arena_mark_t mark);
+void parse_arena_reset(parse_arena_t *arena);
+void parse_arena_fini(parse_arena_t *arena);
 
 // Lexing
 const tok_t *lex(parser_t *parser);
+// Value of the current token, converted on first use. tok_float accepts integers too.
+int64_t tok_int(parser_t *parser);
+double tok_float(parser_t *parser);
+
+// Positions
+// In lazy mode, tok.line and tok.column are -1: the lexer doesn't count lines, and parse_locate
+// works positions out on demand instead. parse_locate works in both modes, for any byte still in
+// the buffer (for streams, in the current window).
+void parse_lazy_positions(parser_t *parser, bool lazy);
+void parse_locate(parser_t *parser, const char *at, int *line, int *column);
+
+// Token arrays
+// parse_tokenize lexes everything from the current token to the end of the input (or the first
+// invalid token, which ends the array like TOK_EOF) into parser->toks, converting numbers up
+// front. From then on, lex() and every primitive walk the array, and parse_seek_tok can go back
+// or forward to any token. Positions work as in lazy mode. Not available for streams, and fails
+// for inputs or tokens too large for parse_token_t.
+size_t parse_tokenize(parser_t *parser);
+size_t parse_tok_index(parser_t *parser);
+void parse_seek_tok(parser_t *parser, size_t index);
+// The full token for a compact one from this parser, position included.
+tok_t parse_token_at(parser_t *parser, const parse_token_t *token);
+
+// Lookahead
+// The token [k] places after the current one (which is peek_tok(parser, 0)), for k up to
+// PARSE_LOOKAHEAD, without consuming anything. Past the end of the input, that's the last token.
+// Not available for streams.
+tok_t peek_tok(parser_t *parser, size_t k);
+
+// Backtracking
+// parse_rewind goes back to where parse_mark was called, with the same current token, and forgets
+// any error raised (or collected) since. Marks stay valid until the parser is reinitialised. Not
+// available for streams.
+parse_mark_t parse_mark(parser_t *parser);
+void parse_rewind(parser_t *parser, const parse_mark_t *mark);
 
 // Recursive Descent Primitives
 bool have(parser_t *parser, tok_kind_t kind);
@@ -89,6 +311,85 @@ int64_t parse_int(parser_t *parser);
 double parse_float(parser_t *parser);
 size_t parse_text(parser_t *parser, char *out, size_t cap);
 
+// Reads up to [count] numbers into [out], stopping (and failing) at the first token that isn't one
+// or doesn't fit. Returns how many were read.
+size_t parse_int_array(parser_t *parser, int64_t *out, size_t count);
+size_t parse_int32_array(parser_t *parser, int32_t *out, size_t count);
+size_t parse_float_array(parser_t *parser, double *out, size_t count);
+size_t parse_float32_array(parser_t *parser, float *out, size_t count);
+
+// Only check the kind of the token (skip_float accepts integers too) and drop it: nothing is
+// converted or copied, so integers out of range are skipped without an error.
+void skip_int(parser_t *parser);
+void skip_float(parser_t *parser);
+void skip_text(parser_t *parser);
+
+// Records
+// A record is a fixed sequence of tokens, each stored at [offset] in a struct (or skipped).
+typedef enum {
+    FIELD_INT,          // int64_t
+    FIELD_INT32,        // int32_t, fails if the value doesn't fit
+    FIELD_FLOAT,        // double, ints accepted
+    FIELD_FLOAT32,      // float, ints accepted
+    FIELD_TEXT,         // char[size], truncated and always NUL-terminated
+    FIELD_SKIP_INT,
+    FIELD_SKIP_FLOAT,
+    FIELD_SKIP_TEXT
+} field_kind_t;
+
+typedef struct {
+    field_kind_t    kind;
+    size_t          offset;
+    double          scale;  // Float fields are multiplied by this, unless it is 0.
+    size_t          size;   // Size of the member: the array for text, checked for numbers.
+} parse_field_t;
+
+#define PARSE_FIELD(kind, type, member) \
+    {(kind), offsetof(type, member), 0, sizeof(((type *)0)->member)}
+#define PARSE_FIELD_SCALED(kind, type, member, scale) \
+    {(kind), offsetof(type, member), (scale), sizeof(((type *)0)->member)}
+#define PARSE_SKIP(kind) {(kind), 0, 0, 0}
+
+// Decodes one record into [out]. On error, fields before the faulty one have been written.
+bool parse_record(parser_t *parser, const parse_field_t *fields, size_t field_count, void *out);
+// Decodes up to [count] records into consecutive structs [stride] bytes apart, and returns how
+// many were decoded completely.
+size_t parse_records(parser_t *parser, const parse_field_t *fields, size_t field_count,
+                     void *out, size_t stride, size_t count);
+
+// Columns
+// Decodes records field by field into separate arrays: data[i] holds [count] values of fields[i],
+// as int64_t, int32_t, double, float or char[size] (offsets are unused). Skipped fields have no
+// column. Must be zero-initialised before the first call, and used with the same fields after.
+typedef struct {
+    size_t      count, cap;
+    size_t      field_count;
+    void        **data;
+} parse_columns_t;
+
+// Appends records to [columns] until the end of input, or until [max] have been read if it isn't
+// 0. Returns the number of records appended; a record that fails halfway isn't.
+size_t parse_columns(parser_t *parser, const parse_field_t *fields, size_t field_count,
+                     parse_columns_t *columns, size_t max);
+void parse_columns_fini(parse_columns_t *columns);
+
+// Parallel parsing
+// Splits [src] into records, separated by lines that are blank or, if [separator] isn't NULL, that
+// are exactly [separator]. Each record that isn't empty gets its own parser, with line numbers
+// counted from the start of [src], and is passed to [record], on up to [threads] threads (0 for
+// one per core). Records are handed out concurrently and in no particular order; parser->src
+// tells where a record starts. Returns the number of records parsed.
+size_t parse_parallel(const char *src, size_t len, const char *separator, int threads,
+                      parse_record_t record, void *data);
+
+// Batch parsing
+// Parses each of the [count] files in [paths] on a pool of [threads] threads (0 for one per core),
+// and calls [file] with a parser over it. Files that can't be opened are still passed to [file],
+// with parser->error set. Returns the number of files that had an error once [file] returned;
+// errors never stop the batch.
+size_t parse_batch(const char *const *paths, size_t count, int threads,
+                   parse_file_t file, void *data);
+
 #ifdef __cplusplus
 }
 #endif
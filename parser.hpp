@@ -0,0 +1,172 @@
+/*===--------------------------------------------------------------------------------------------===
+ * parser.hpp
+ *
+ * Compile-time record schemas for C++17, on top of parser.h. A record is a list of fields given as
+ * template arguments, and decoding one is a fold over them: no descriptor is looked at at runtime.
+ *
+ *     struct sv_t { int64_t prn; double ecc; float inc; };
+ *     struct pi { static constexpr double value = M_PI; };
+ *
+ *     using sv_record = parse::record<sv_t,
+ *         parse::field<&sv_t::prn>,
+ *         parse::skip<TOK_INT>,
+ *         parse::field<&sv_t::ecc>,
+ *         parse::scaled<&sv_t::inc, pi>>;
+ *
+ *     size_t n = sv_record::decode(&parser, svs, count);
+ *
+ * Created by Amy Parent <amy@amyparent.com>
+ * Copyright (c) 2022 Amy Parent
+ *
+ * Licensed under the MIT License
+ *===--------------------------------------------------------------------------------------------===
+*/
+#ifndef _PARSER_HPP_
+#define _PARSER_HPP_
+
+#include "parser.h"
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+namespace parse {
+
+namespace detail {
+
+template <typename T>
+struct member_of;
+
+template <typename C, typename M>
+struct member_of<M C::*> {
+    using type = M;
+};
+
+template <typename T>
+inline bool decode_int(parser_t *parser, T &out) {
+    if(!have(parser, TOK_INT)) {
+        expect(parser, TOK_INT);
+        return false;
+    }
+    int64_t value = tok_int(parser);
+    if(parser->error) return false;
+    if constexpr(!std::is_same_v<T, int64_t>) {
+        if(value < (int64_t)std::numeric_limits<T>::min()
+           || (value > 0 && (uint64_t)value > (uint64_t)std::numeric_limits<T>::max())) {
+            parse_range_error(parser);
+            return false;
+        }
+    }
+    out = (T)value;
+    lex(parser);
+    return true;
+}
+
+template <typename T>
+inline bool decode_float(parser_t *parser, T &out, double scale) {
+    if(!have(parser, TOK_FLOAT) && !have(parser, TOK_INT)) {
+        expect(parser, TOK_FLOAT);
+        return false;
+    }
+    out = (T)(tok_float(parser) * scale);
+    if(parser->error) return false;
+    lex(parser);
+    return true;
+}
+
+inline bool decode_text(parser_t *parser, char *out, size_t size) {
+    if(!have(parser, TOK_TEXT)) {
+        expect(parser, TOK_TEXT);
+        return false;
+    }
+    size_t len = parser->tok.len < size ? parser->tok.len : size - 1;
+    std::memcpy(out, parser->tok.start, len);
+    out[len] = '\0';
+    lex(parser);
+    return true;
+}
+
+inline bool decode_text(parser_t *parser, std::string &out) {
+    if(!have(parser, TOK_TEXT)) {
+        expect(parser, TOK_TEXT);
+        return false;
+    }
+    out.assign(parser->tok.start, parser->tok.len);
+    lex(parser);
+    return true;
+}
+
+template <typename T>
+inline bool decode_value(parser_t *parser, T &out, double scale) {
+    if constexpr(std::is_floating_point_v<T>) {
+        return decode_float(parser, out, scale);
+    } else if constexpr(std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+        return decode_int(parser, out);
+    } else if constexpr(std::is_array_v<T>) {
+        static_assert(std::is_same_v<std::remove_extent_t<T>, char>, "text fields are char[N]");
+        return decode_text(parser, out, sizeof(T));
+    } else {
+        static_assert(std::is_same_v<T, std::string>, "unsupported field type");
+        return decode_text(parser, out);
+    }
+}
+
+} // namespace detail
+
+// Stores the next token in [Member], converted to its type: integers, floating point numbers,
+// char arrays (truncated and NUL-terminated) and std::string.
+template <auto Member>
+struct field {
+    template <typename T>
+    static bool decode(parser_t *parser, T &out) {
+        return detail::decode_value(parser, out.*Member, 1.0);
+    }
+};
+
+// Like field, for floating point members, multiplied by Scale::value.
+template <auto Member, typename Scale>
+struct scaled {
+    static_assert(std::is_floating_point_v<typename detail::member_of<decltype(Member)>::type>,
+                  "only floating point fields can be scaled");
+
+    template <typename T>
+    static bool decode(parser_t *parser, T &out) {
+        return detail::decode_value(parser, out.*Member, Scale::value);
+    }
+};
+
+// Checks that the next token is a [Kind] (TOK_FLOAT also accepts integers) and drops it.
+template <tok_kind_t Kind>
+struct skip {
+    template <typename T>
+    static bool decode(parser_t *parser, T &) {
+        if constexpr(Kind == TOK_FLOAT) {
+            skip_float(parser);
+        } else {
+            expect(parser, Kind);
+        }
+        return !parser->error;
+    }
+};
+
+template <typename T, typename... Fields>
+struct record {
+    // Decodes one record into [out]. On error, fields before the faulty one have been written.
+    static bool decode(parser_t *parser, T &out) {
+        if(parser->error) return false;
+        return (Fields::decode(parser, out) && ...);
+    }
+
+    // Decodes up to [count] records into [out], and returns how many were decoded completely.
+    static size_t decode(parser_t *parser, T *out, size_t count) {
+        size_t n = 0;
+        while(n < count && decode(parser, out[n])) {
+            n += 1;
+        }
+        return n;
+    }
+};
+
+} // namespace parse
+
+#endif /* ifndef _PARSER_HPP_ */